@@ -0,0 +1,124 @@
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "dirent.h"
+#include "interface.h"
+
+#define TRUE 1
+#define FALSE 0
+
+typedef struct {
+    pid_t pid;      // 0 before it started, -1 once it finished
+    FILE *output;   // everything the directory's compiler printed
+    int status;     // 0 compiled, 1 diagnostics, anything else a compiler that did not finish
+} BatchEntry;
+
+// runs in the child, which shares the parent's tables copy-on-write
+void compile_batch_entry(char *dir_name, FILE *output) {
+    dup2(fileno(output), STDOUT_FILENO);
+    DIR *dir = opendir(dir_name);
+    if (dir == NULL) {
+        printf("Directory %s does not exist.\n", dir_name);
+        fflush(stdout);
+        _exit(1);
+    }
+    closedir(dir);
+    ParserInfo parser_info = compile(dir_name);
+    if (parser_info.er != none) {
+        print_compile_error(parser_info);
+    }
+    fflush(stdout);
+    _exit(parser_info.er != none);
+}
+
+void report_batch_entry(char *dir_name, BatchEntry *entry) {
+    printf("== %s: %s\n", dir_name, entry->status == 0 ? "ok" : entry->status == 1 ? "failed" : "crashed");
+    rewind(entry->output);
+    char buffer[8192];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), entry->output)) > 0) {
+        fwrite(buffer, 1, size, stdout);
+    }
+    fclose(entry->output);
+    entry->output = NULL;
+}
+
+// every directory is compiled in a child forked from the process holding the library tables, at most jobs at
+// a time, reports come in the order of dir_names, returns the number of directories that did not compile
+int compile_batch(char **dir_names, int count, int jobs) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // every directory builds once, --watch would keep the first child running
+    get_compiler_options()->watch = FALSE;
+
+    // each child starts from this program table, compile() only drops the program classes a child adds;
+    // parsed once for the whole batch, no single program's build directory gets the interface file
+    ParserInfo parser_info = load_library(NULL, library_source_hash("."));
+    if (parser_info.er != none) {
+        print_compile_error(parser_info);
+        return count;
+    }
+
+    BatchEntry *entries = (BatchEntry *)calloc(count + 1, sizeof(BatchEntry));
+    int started = 0;
+    int running = 0;
+    int reported = 0;
+    int failed = 0;
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    while (reported < count) {
+        while (running < jobs && started < count) {
+            BatchEntry *entry = &entries[started];
+            entry->output = tmpfile();
+            fflush(stdout);
+            entry->pid = entry->output != NULL ? fork() : -1;
+            if (entry->pid == 0) {
+                compile_batch_entry(dir_names[started], entry->output);
+            }
+            if (entry->pid < 0) {
+                // a directory that could not start reports as crashed
+                entry->status = 2;
+                if (entry->output == NULL) {
+                    entry->output = tmpfile();
+                }
+            } else {
+                running += 1;
+            }
+            started += 1;
+        }
+
+        if (running > 0) {
+            int status;
+            pid_t pid = wait(&status);
+            for (int i = 0; pid > 0 && i < started; i++) {
+                if (entries[i].pid == pid) {
+                    entries[i].pid = -1;
+                    entries[i].status = WIFEXITED(status) ? WEXITSTATUS(status) : 2;
+                    running -= 1;
+                }
+            }
+        }
+
+        // finished directories report once every directory before them has
+        while (reported < started && entries[reported].pid == -1) {
+            if (entries[reported].output != NULL) {
+                report_batch_entry(dir_names[reported], &entries[reported]);
+            }
+            failed += entries[reported].status != 0;
+            reported += 1;
+        }
+    }
+    free(entries);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    printf("batch: %d of %d directories compiled in %.3f ms\n", count - failed, count, elapsed);
+    return failed;
+}
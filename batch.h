@@ -0,0 +1,8 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// compile many program directories in one process against a library parsed once
+
+int compile_batch(char **dir_names, int count, int jobs);
+
+#endif
@@ -0,0 +1,350 @@
+#include "cache.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "compiler.h"
+#include "dirent.h"
+#include "interface.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// class name to program table position, open addressing over a power of two
+typedef struct {
+    char *name;
+    int order;  // position in the program table, keys list their classes in this order
+} CachedInterface;
+
+char cache_dir[512];
+long cache_limit = 0;
+int cache_open = FALSE;
+int cache_hits = 0;
+int cache_misses = 0;
+int cache_stores = 0;
+
+CachedInterface *cached_interfaces = NULL;
+unsigned long long *interface_hashes = NULL;  // by program table position
+int cached_interface_slots = 0;
+int cached_interface_count = 0;
+char *referenced_classes = NULL;
+
+unsigned long long class_interface_hash(TableRow *class) {
+    unsigned long long hash = hash_bytes(14695981039346656037ull, class->token.lx, strlen(class->token.lx) + 1);
+    SymbolTable *table = class->child_table;
+    for (int i = 0; table != NULL && i < table->size; i++) {
+        TableRow *row = table->rows[i];
+        int numbers[3] = {row->kind, row->stack_idx, row->child_table != NULL ? row->child_table->symbol_kind_cnt[ARGS] : -1};
+        hash = hash_bytes(hash, row->token.lx, strlen(row->token.lx) + 1);
+        hash = hash_bytes(hash, row->type, strlen(row->type) + 1);
+        hash = hash_bytes(hash, numbers, sizeof(numbers));
+    }
+    return hash;
+}
+
+unsigned int interface_slot(char *name, int length) {
+    return (unsigned int)hash_bytes(14695981039346656037ull, name, length) & (cached_interface_slots - 1);
+}
+
+CachedInterface *find_cached_interface(char *name, int length) {
+    unsigned int slot = interface_slot(name, length);
+    while (cached_interfaces[slot].name != NULL) {
+        if (strncmp(cached_interfaces[slot].name, name, length) == 0 && cached_interfaces[slot].name[length] == '\0') {
+            return &cached_interfaces[slot];
+        }
+        slot = (slot + 1) & (cached_interface_slots - 1);
+    }
+    return NULL;
+}
+
+// name lookup and interface hashes of every class in the program table, rebuilt whenever the table is
+void index_class_interfaces() {
+    free_class_interfaces();
+    SymbolTable *program_table = get_program_table();
+    cached_interface_count = program_table->size;
+    cached_interface_slots = 16;
+    while (cached_interface_slots < cached_interface_count * 2) {
+        cached_interface_slots *= 2;
+    }
+    cached_interfaces = (CachedInterface *)calloc(cached_interface_slots, sizeof(CachedInterface));
+    referenced_classes = (char *)calloc(cached_interface_count + 1, sizeof(char));
+    interface_hashes = (unsigned long long *)malloc(sizeof(unsigned long long) * (cached_interface_count + 1));
+    for (int i = 0; i < program_table->size; i++) {
+        TableRow *class = program_table->rows[i];
+        unsigned int slot = interface_slot(class->token.lx, strlen(class->token.lx));
+        while (cached_interfaces[slot].name != NULL) {
+            slot = (slot + 1) & (cached_interface_slots - 1);
+        }
+        cached_interfaces[slot].name = class->token.lx;
+        cached_interfaces[slot].order = i;
+        interface_hashes[i] = class_interface_hash(class);
+    }
+}
+
+void free_class_interfaces() {
+    free(cached_interfaces);
+    cached_interfaces = NULL;
+    free(referenced_classes);
+    referenced_classes = NULL;
+    free(interface_hashes);
+    interface_hashes = NULL;
+    cached_interface_count = 0;
+}
+
+// position of the class in the program table, -1 when there is none
+int find_indexed_class(char *name) {
+    CachedInterface *interface = find_cached_interface(name, strlen(name));
+    return interface != NULL ? interface->order : -1;
+}
+
+// interface hash of the class at position order of the program table
+unsigned long long indexed_interface_hash(int order) {
+    return interface_hashes[order];
+}
+
+// flags by program table position for every identifier naming a class, comments and strings included,
+// a spare dependency only costs a rebuild
+char *find_referenced_classes(char *source, long size) {
+    memset(referenced_classes, FALSE, cached_interface_count);
+    long i = 0;
+    while (i < size) {
+        if (isalpha((unsigned char)source[i]) || source[i] == '_') {
+            long start = i;
+            while (i < size && (isalnum((unsigned char)source[i]) || source[i] == '_')) {
+                i += 1;
+            }
+            CachedInterface *interface = find_cached_interface(source + start, i - start);
+            if (interface != NULL) {
+                referenced_classes[interface->order] = TRUE;
+            }
+        } else {
+            i += 1;
+        }
+    }
+    return referenced_classes;
+}
+
+// the whole file NUL terminated, NULL when it can not be read
+char *read_source_file(char *path, long *size) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *source = (char *)malloc(*size + 1);
+    *size = fread(source, 1, *size, file);
+    source[*size] = '\0';
+    fclose(file);
+    return source;
+}
+
+// the code generator and every option that changes the code it writes for a class, the same for every build
+// of the compiler so rebuilding it keeps the cache; the whole-program passes run after the cached code
+unsigned long long compiler_hash() {
+    CompilerOptions *options = get_compiler_options();
+    int switches[3] = {CODEGEN_VERSION, options->intrinsics, options->tail_calls};
+    return hash_bytes(14695981039346656037ull, switches, sizeof(switches));
+}
+
+// called once the program table is complete, i.e. right before code generation
+int open_class_cache(char *dir_name, long limit) {
+    if (mkdir(dir_name, 0755) != 0) {
+        struct stat info;
+        if (stat(dir_name, &info) != 0 || S_ISDIR(info.st_mode) == 0) {
+            printf("can not use cache directory %s\n", dir_name);
+            return FALSE;
+        }
+    }
+    strncpy(cache_dir, dir_name, sizeof(cache_dir) - 1);
+    cache_dir[sizeof(cache_dir) - 1] = '\0';
+    cache_limit = limit;
+    cache_hits = 0;
+    cache_misses = 0;
+    cache_stores = 0;
+    index_class_interfaces();
+    cache_open = TRUE;
+    return TRUE;
+}
+
+// the source bytes, the compiler, and the interface of every class the source names
+unsigned long long class_cache_key(char *source_path) {
+    long size;
+    char *source = read_source_file(source_path, &size);
+    if (source == NULL) {
+        return 0;
+    }
+
+    unsigned long long key = hash_bytes(compiler_hash(), source, size);
+    char *referenced = find_referenced_classes(source, size);
+    for (int order = 0; order < cached_interface_count; order++) {
+        if (referenced[order] == TRUE) {
+            key = hash_bytes(key, &interface_hashes[order], sizeof(interface_hashes[order]));
+        }
+    }
+    free(source);
+    return key;
+}
+
+int copy_file(char *from, char *to) {
+    FILE *input = fopen(from, "rb");
+    if (input == NULL) {
+        return FALSE;
+    }
+    FILE *output = fopen(to, "wb");
+    if (output == NULL) {
+        fclose(input);
+        return FALSE;
+    }
+    char buffer[8192];
+    size_t size;
+    int ok = TRUE;
+    while ((size = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+        if (fwrite(buffer, 1, size, output) != size) {
+            ok = FALSE;
+        }
+    }
+    fclose(input);
+    if (fclose(output) != 0) {
+        ok = FALSE;
+    }
+    return ok;
+}
+
+void cache_entry_path(char *path, int size, unsigned long long key) {
+    snprintf(path, size, "%s/%016llx.vm", cache_dir, key);
+}
+
+// copy the cached code to output_path, FALSE on a miss
+int fetch_cached_class(unsigned long long key, char *output_path) {
+    char path[1024];
+    cache_entry_path(path, sizeof(path), key);
+    if (copy_file(path, output_path) == FALSE) {
+        cache_misses += 1;
+        return FALSE;
+    }
+    // the modification time is the entry's last use, eviction goes by it
+    utime(path, NULL);
+    cache_hits += 1;
+    return TRUE;
+}
+
+void store_cached_class(unsigned long long key, char *output_path) {
+    char path[1024];
+    char temporary[1100];
+    cache_entry_path(path, sizeof(path), key);
+    // per process, builds sharing the directory may store the same key at once
+    snprintf(temporary, sizeof(temporary), "%s.%d", path, (int)getpid());
+    if (copy_file(output_path, temporary) == TRUE && rename(temporary, path) == 0) {
+        cache_stores += 1;
+    } else {
+        remove(temporary);
+    }
+}
+
+typedef struct {
+    char name[64];
+    long size;
+    long long used;  // modification time in nanoseconds
+} CacheEntry;
+
+int compare_cache_entries(const void *a, const void *b) {
+    long long x = ((CacheEntry *)a)->used;
+    long long y = ((CacheEntry *)b)->used;
+    return x < y ? -1 : x > y;
+}
+
+// least recently used entries go first until the directory fits the limit, returns the number removed
+int evict_cache_entries() {
+    DIR *dir = opendir(cache_dir);
+    if (dir == NULL) {
+        return 0;
+    }
+    int count = 0;
+    int capacity = 64;
+    CacheEntry *entries = (CacheEntry *)malloc(sizeof(CacheEntry) * capacity);
+    long total = 0;
+    struct dirent *entry;
+    char path[1024];
+    while ((entry = readdir(dir)) != NULL) {
+        char *dot = strrchr(entry->d_name, '.');
+        struct stat info;
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+        if (dot == NULL || strcmp(dot, ".vm") != 0 || strlen(entry->d_name) >= sizeof(entries[0].name) || stat(path, &info) != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            entries = (CacheEntry *)realloc(entries, sizeof(CacheEntry) * capacity);
+        }
+        strcpy(entries[count].name, entry->d_name);
+        entries[count].size = info.st_size;
+        entries[count].used = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+        total += info.st_size;
+        count += 1;
+    }
+    closedir(dir);
+
+    int evicted = 0;
+    if (total > cache_limit) {
+        qsort(entries, count, sizeof(CacheEntry), compare_cache_entries);
+        for (int i = 0; i < count && total > cache_limit; i++) {
+            snprintf(path, sizeof(path), "%s/%s", cache_dir, entries[i].name);
+            if (remove(path) == 0) {
+                total -= entries[i].size;
+                evicted += 1;
+            }
+        }
+    }
+    free(entries);
+    printf("cache: %d hits, %d misses, %d stored, %d evicted, %ld of %ld bytes used\n", cache_hits, cache_misses, cache_stores, evicted, total, cache_limit);
+    return evicted;
+}
+
+// totals over every build that used the directory, kept next to the entries and locked while they are added to
+void update_cache_stats(int evicted) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/stats", cache_dir);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return;
+    }
+    FILE *file = fdopen(fd, "r+");
+    if (file == NULL || flock(fd, LOCK_EX) != 0) {
+        if (file != NULL) {
+            fclose(file);
+        } else {
+            close(fd);
+        }
+        return;
+    }
+    long hits = 0, misses = 0, removed = 0;
+    if (fscanf(file, "hits %ld misses %ld evicted %ld", &hits, &misses, &removed) != 3) {
+        hits = misses = removed = 0;
+    }
+    rewind(file);
+    fprintf(file, "hits %ld misses %ld evicted %ld\n", hits + cache_hits, misses + cache_misses, removed + evicted);
+    fflush(file);
+    if (ftruncate(fd, ftell(file)) != 0) {
+        printf("can not update cache statistics %s\n", path);
+    }
+    // closing the file releases the lock
+    fclose(file);
+}
+
+void close_class_cache() {
+    if (cache_open == FALSE) {
+        return;
+    }
+    update_cache_stats(evict_cache_entries());
+    free_class_interfaces();
+    cache_open = FALSE;
+}
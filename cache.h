@@ -0,0 +1,31 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "symbols.h"
+
+// content-addressed cache of the VM code generated for each class, shared by every build that uses the directory
+
+// bump with every change to the code parser.c and vmcode.c write for the same source, cached classes and
+// build manifests keyed on an older version are generated again
+#define CODEGEN_VERSION 1
+
+// what a class's declarations look like to its callers, names, kinds, types, stack indices and argument counts
+unsigned long long class_interface_hash(TableRow *class);
+
+// shared with the build manifest, valid until the program table changes
+void index_class_interfaces();
+void free_class_interfaces();
+int find_indexed_class(char *name);
+unsigned long long indexed_interface_hash(int order);
+char *find_referenced_classes(char *source, long size);
+char *read_source_file(char *path, long *size);
+unsigned long long compiler_hash();
+int copy_file(char *from, char *to);
+
+int open_class_cache(char *dir_name, long limit);
+unsigned long long class_cache_key(char *source_path);
+int fetch_cached_class(unsigned long long key, char *output_path);
+void store_cached_class(unsigned long long key, char *output_path);
+void close_class_cache();
+
+#endif
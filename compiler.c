@@ -1,19 +1,166 @@
 #include "compiler.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
 
+#include "cache.h"
 #include "dirent.h"
+#include "interface.h"
+#include "ir.h"
+#include "linker.h"
+#include "manifest.h"
+#include "passes.h"
+#include "profile.h"
 #include "string.h"
 #include "symbols.h"
+#include "vmcode.h"
+#include "watch.h"
 
 int is_codegen = FALSE;
 
+// the library part of the program table, -1 while it holds no complete library
+unsigned long long loaded_library_hash = 0;
+int library_classes = -1;
+int library_unchecked = 0;
+
+// a failure outside the program's sources exits a standalone compiler, a resident one returns from compile() instead
+int resident_compiler = FALSE;
+int compile_failure = FALSE;
+
+CompilerOptions compiler_options = {FALSE, 0, FALSE, FALSE, FALSE, 0, FALSE, NULL, FALSE, FALSE, NULL, 64L << 20, FALSE, FALSE, FALSE};
+
+CompilerOptions *get_compiler_options() {
+    return &compiler_options;
+}
+
+// -O0 / -O1 / -O2, selects the whole-program passes and the subroutine pass pipeline
+void set_optimization_level(int level) {
+    compiler_options.level = level;
+    compiler_options.tree_shaking = level >= 1;
+    compiler_options.tail_calls = level >= 1;
+    compiler_options.optimize = level >= 1;
+    compiler_options.folding = level >= 1;
+    compiler_options.intrinsics = level >= 1;
+    compiler_options.inline_budget = level >= 2 ? 12 : 0;
+    enable_ir_passes(level);
+}
+
+// one command line flag: -O<n>, -f<pass> / -fno-<pass>, -ftime-passes, -fopt-report, -fdump-ir,
+// -fprofile-use=<path>, -fcache-dir=<path>, -fcache-size=<bytes> or --watch, FALSE when unknown
+int set_compiler_flag(char *flag) {
+    if (strlen(flag) == 3 && strncmp(flag, "-O", 2) == 0 && flag[2] >= '0' && flag[2] <= '2') {
+        set_optimization_level(flag[2] - '0');
+        return TRUE;
+    }
+    if (strncmp(flag, "-fprofile-use=", 14) == 0) {
+        compiler_options.profile = flag + 14;
+        return TRUE;
+    }
+    if (strncmp(flag, "-fcache-dir=", 12) == 0) {
+        compiler_options.cache_dir = flag + 12;
+        return TRUE;
+    }
+    if (strncmp(flag, "-fcache-size=", 13) == 0) {
+        // bytes, or with a K / M suffix
+        char *end;
+        long size = strtol(flag + 13, &end, 10);
+        size *= *end == 'K' ? 1L << 10 : *end == 'M' ? 1L << 20 : 1;
+        if (size <= 0 || (*end != '\0' && end[1] != '\0')) {
+            printf("bad cache size %s\n", flag + 13);
+            return FALSE;
+        }
+        compiler_options.cache_limit = size;
+        return TRUE;
+    }
+    if (strcmp(flag, "--watch") == 0) {
+        compiler_options.watch = TRUE;
+        return TRUE;
+    }
+    if (strncmp(flag, "-f", 2) != 0) {
+        printf("unknown compiler flag %s\n", flag);
+        return FALSE;
+    }
+
+    int enabled = strncmp(flag, "-fno-", 5) != 0;
+    char *name = enabled == TRUE ? flag + 2 : flag + 5;
+    IrPassEntry *pass = find_ir_pass(name);
+    if (pass != NULL) {
+        pass->enabled = enabled;
+        if (enabled == TRUE) {
+            compiler_options.optimize = TRUE;
+        }
+    } else if (strcmp(name, "inline") == 0) {
+        compiler_options.inline_budget = enabled == TRUE ? 12 : 0;
+    } else if (strcmp(name, "tree-shaking") == 0) {
+        compiler_options.tree_shaking = enabled;
+    } else if (strcmp(name, "tail-calls") == 0) {
+        compiler_options.tail_calls = enabled;
+    } else if (strcmp(name, "icf") == 0) {
+        compiler_options.folding = enabled;
+    } else if (strcmp(name, "intrinsics") == 0) {
+        compiler_options.intrinsics = enabled;
+    } else if (strcmp(name, "incremental") == 0) {
+        compiler_options.incremental = enabled;
+    } else if (strcmp(name, "time-passes") == 0) {
+        compiler_options.time_passes = enabled;
+    } else if (strcmp(name, "opt-report") == 0) {
+        compiler_options.report = enabled;
+    } else if (strcmp(name, "dump-ir") == 0) {
+        compiler_options.dump_ir = enabled;
+    } else {
+        printf("unknown compiler flag %s\n", flag);
+        return FALSE;
+    }
+    return TRUE;
+}
+
 int is_codegen_phase() {
     return is_codegen;
 }
 
+void set_resident_compiler(int resident) {
+    resident_compiler = resident;
+}
+
+// TRUE when the last compile() stopped on a file or directory it could not use, rather than on the program
+int has_compile_failed() {
+    return compile_failure;
+}
+
+// what SyntaxErrors stand for, the entry points here report compile() errors without the driver's PrintError
+char *compile_error_messages[] = {"no error", "lexer error", "keyword class expected", "identifier expected",
+                                  "{ expected", "} expected", "class member declaration must begin with static, field, constructor, function, or method",
+                                  "class variables must begin with field or static", "a type must be int, char, boolean, or identifier",
+                                  "; expected", "subroutine declaration must begin with constructor, function, or method",
+                                  "( expected", ") expected", "] expected", "= expected", "syntax error",
+                                  "undeclared identifier", "redeclaration of identifier"};
+
+void print_compile_error(ParserInfo parser_info) {
+    int count = sizeof(compile_error_messages) / sizeof(compile_error_messages[0]);
+    char *message = parser_info.er >= 0 && (int)parser_info.er < count ? compile_error_messages[parser_info.er] : "error";
+    printf("%s:%d: %s at %s\n", parser_info.tk.fl, parser_info.tk.ln, message, parser_info.tk.lx);
+}
+
+void fail_compile() {
+    if (resident_compiler == FALSE) {
+        exit(1);
+    }
+    compile_failure = TRUE;
+}
+
 int InitCompiler() {
+    // subroutine passes in the order they run, with the lowest level that enables them
+    add_ir_pass("unreachable", remove_unreachable_blocks, 1);
+    add_ir_pass("branches", simplify_branches, 1);
+    add_ir_pass("licm", hoist_loop_invariants, 2);
+    add_ir_pass("cse", number_values, 2);
+    add_ir_pass("dse", remove_dead_stores, 1);
+    add_ir_pass("layout", layout_blocks, 2);
+    enable_ir_passes(compiler_options.level);
+
     return init_symbol();  // return 1;
 }
 
@@ -24,10 +171,11 @@ char file_to_be_compiled[512];
 char output_file_path[512];
 
 FILE *get_output_file() {
-    FILE *output_file = fopen(output_file_path, "w");
+    // opened for reading too, the code generator patches functions it has already written
+    FILE *output_file = fopen(output_file_path, "w+");
     if (output_file == NULL) {
         printf("error when trying to create or open the compiled file path\n");
-        exit(1);
+        fail_compile();
     }
     return output_file;
 }
@@ -46,15 +194,82 @@ char *replace_file_suffix(const char *filename, const char *suffix) {
     return NULL;
 }
 
-ParserInfo compile(char *dir_name) {
+// same format as the subroutine pass report, inlining counts the instructions it added as negative
+void report_program_pass(char *name, int removed, clock_t start, int enabled) {
+    if (compiler_options.time_passes == TRUE && enabled == TRUE) {
+        printf("optimization: %-12s %6d instructions removed %9.3f ms\n", name, removed, (double)(clock() - start) / CLOCKS_PER_SEC * 1000);
+    }
+}
+
+// whole-program passes over the classes just generated
+void optimize_program(VmProgram *program) {
+    // -O0 keeps the code as parsed
+    if (compiler_options.inline_budget == 0 && compiler_options.tree_shaking == FALSE && compiler_options.level == 0 &&
+        compiler_options.optimize == FALSE && compiler_options.dump_ir == FALSE && compiler_options.folding == FALSE) {
+        return;
+    }
+    for (int i = 0; i < program->size; i++) {
+        if (read_vm_file(&program->files[i]) == FALSE) {
+            fail_compile();
+            return;
+        }
+    }
+
+    int changed = FALSE;
+    int before = count_vm_instructions(program);
+    clock_t start = clock();
+    if (compiler_options.inline_budget > 0 && inline_functions(program, compiler_options.inline_budget) > 0) {
+        changed = TRUE;
+    }
+    report_program_pass("inline", before - count_vm_instructions(program), start, compiler_options.inline_budget > 0);
+
+    before = count_vm_instructions(program);
+    start = clock();
+    if (compiler_options.tree_shaking == TRUE && shake_tree(program) > 0) {
+        changed = TRUE;
+    }
+    report_program_pass("tree-shaking", before - count_vm_instructions(program), start, compiler_options.tree_shaking);
+
+    // a profile orders functions from -O1 on, like the passes it guides
+    if (compiler_options.level >= 1 && has_profile() == TRUE && order_functions(program) > 0) {
+        changed = TRUE;
+    }
+
+    if (compiler_options.optimize == TRUE || compiler_options.dump_ir == TRUE) {
+        if (compiler_options.optimize == FALSE) {
+            enable_ir_passes(0);
+        }
+        run_ir_passes(program, compiler_options.dump_ir);
+        if (compiler_options.time_passes == TRUE || compiler_options.report == TRUE) {
+            print_ir_pass_report(compiler_options.time_passes);
+        }
+        changed = TRUE;
+    }
+
+    // after the subroutine passes, which make more copies identical
+    before = count_vm_instructions(program);
+    start = clock();
+    if (compiler_options.folding == TRUE && fold_identical_functions(program) > 0) {
+        changed = TRUE;
+    }
+    report_program_pass("icf", before - count_vm_instructions(program), start, compiler_options.folding);
+
+    if (changed == TRUE && write_vm_program(program) == FALSE) {
+        fail_compile();
+    }
+}
+
+// declarations of every .jack file in a directory, their subroutine bodies are skipped
+ParserInfo parse_declarations(char *dir_name) {
     ParserInfo parser_info;
+    parser_info.er = none;
 
-    // parse jack built-in libraries
     struct dirent *lib_file;
-    DIR *curr_dir = opendir(".");
+    DIR *curr_dir = opendir(dir_name);
     if (curr_dir == NULL) {
         printf("Failed to open current dir\n");
-        exit(1);
+        fail_compile();
+        return parser_info;
     }
     while ((lib_file = readdir(curr_dir)) != NULL) {
         if (strstr(lib_file->d_name, ".jack") == NULL) {
@@ -62,29 +277,116 @@ ParserInfo compile(char *dir_name) {
         };
 
         // string concatenation for file path
-        strcpy(lib_file_path, "./");
+        strcpy(lib_file_path, dir_name);
+        strcat(lib_file_path, "/");
         strcat(lib_file_path, lib_file->d_name);
 
         // parse individual file, return error in error exists
         int init_parser = InitParser(lib_file_path);
         if (init_parser == 0) {
+            closedir(curr_dir);
             parser_info.er = lexerErr;
             return parser_info;
         }
+        SetSkimParsing(TRUE);
         parser_info = Parse();
+        SetSkimParsing(FALSE);
         StopParser();
         if (parser_info.er != none) {
+            closedir(curr_dir);
             return parser_info;
         }
     }
     closedir(curr_dir);
+    return parser_info;
+}
+
+// jack built-in libraries come from their interface file in the program's build directory while their sources
+// are unchanged, and stay at the start of the program table for the next compile in the same process;
+// a NULL dir_name parses them without reading or writing an interface file
+ParserInfo load_library(char *dir_name, unsigned long long library_hash) {
+    ParserInfo parser_info;
+    parser_info.er = none;
+    if (library_classes >= 0 && loaded_library_hash == library_hash) {
+        reset_program_table(library_classes, library_unchecked);
+        return parser_info;
+    }
+
+    stop_symbol();
+    init_symbol();
+    library_classes = -1;
+    char path[512];
+    if (dir_name != NULL) {
+        snprintf(path, sizeof(path), "%s/%s/%s", dir_name, BUILD_DIR, INTERFACE_FILE);
+    }
+    if (dir_name == NULL || load_interface(path, library_hash) == FALSE) {
+        parser_info = parse_declarations(".");
+        if (parser_info.er != none || compile_failure == TRUE) {
+            return parser_info;
+        }
+        if (dir_name != NULL) {
+            char build_dir[512];
+            snprintf(build_dir, sizeof(build_dir), "%s/%s", dir_name, BUILD_DIR);
+            // a program directory that does not exist is reported by compile()
+            if (mkdir(build_dir, 0755) == 0 || errno == EEXIST) {
+                write_interface(path, library_hash);
+            }
+        }
+    }
+    loaded_library_hash = library_hash;
+    library_classes = get_program_table()->size;
+    library_unchecked = count_unchecked_symbols();
+    return parser_info;
+}
+
+ParserInfo compile(char *dir_name) {
+    ParserInfo parser_info;
+    compile_failure = FALSE;
+
+    // --watch, every rebuild comes back through here, returns the last build once the directory is gone
+    if (compiler_options.watch == TRUE) {
+        compiler_options.watch = FALSE;
+        parser_info = watch_program(dir_name);
+        compiler_options.watch = TRUE;
+        return parser_info;
+    }
+
+    // a profile that can not be read leaves the build unguided
+    free_profile();
+    if (compiler_options.profile != NULL && load_profile(compiler_options.profile) == FALSE) {
+        printf("compiling without profile\n");
+    }
+
+    unsigned long long library_hash = library_source_hash(".");
+    parser_info = load_library(dir_name, library_hash);
+    if (parser_info.er != none || compile_failure == TRUE) {
+        return parser_info;
+    }
+
+    // skim every class to compare its interface with the last build, then start over from the library;
+    // declarations that do not parse leave the full parse below to report the error
+    int incremental = compiler_options.incremental;
+    if (incremental == TRUE) {
+        parser_info = parse_declarations(dir_name);
+        if (parser_info.er == none && compile_failure == FALSE) {
+            plan_incremental_build(dir_name, library_hash);
+        } else {
+            incremental = FALSE;
+        }
+        parser_info = load_library(dir_name, library_hash);
+        if (parser_info.er != none) {
+            discard_build_manifest();
+            return parser_info;
+        }
+    }
 
     // parse given program
     struct dirent *program_file;
     DIR *dir = opendir(dir_name);
     if (dir == NULL) {
         printf("Directory %s does not exist.\n", dir_name);
-        exit(1);
+        fail_compile();
+        return parser_info;
     }
 
     while ((program_file = readdir(dir)) != NULL) {
@@ -100,12 +402,19 @@ ParserInfo compile(char *dir_name) {
         // parse individual file, return error in error exists
         int init_parser = InitParser(file_path);
         if (init_parser == 0) {
+            closedir(dir);
+            discard_build_manifest();
             parser_info.er = lexerErr;
             return parser_info;
         }
+        // classes no change can affect were checked by an earlier build, only their declarations are needed
+        SetSkimParsing(incremental == TRUE && is_file_affected(program_file->d_name) == FALSE);
         parser_info = Parse();
+        SetSkimParsing(FALSE);
         StopParser();
         if (parser_info.er != none) {
+            closedir(dir);
+            discard_build_manifest();
             return parser_info;
         }
     }
@@ -113,6 +422,8 @@ ParserInfo compile(char *dir_name) {
     // find undeclared identifier
     parser_info = find_undeclared_identifier();
     if (parser_info.er != none) {
+        closedir(dir);
+        discard_build_manifest();
         return parser_info;
     }
 
@@ -120,6 +431,12 @@ ParserInfo compile(char *dir_name) {
     rewinddir(dir);
     is_codegen = TRUE;
 
+    VmProgram program;
+    init_vm_program(&program);
+
+    // classes generated before from the same source against the same interfaces are copied from the cache
+    int use_cache = compiler_options.cache_dir != NULL && open_class_cache(compiler_options.cache_dir, compiler_options.cache_limit) == TRUE;
+
     while ((program_file = readdir(dir)) != NULL) {
         if (strstr(program_file->d_name, ".jack") == NULL) {
             continue;
@@ -145,26 +462,68 @@ ParserInfo compile(char *dir_name) {
         strcat(file_to_be_compiled, "/");
         strcat(file_to_be_compiled, program_file->d_name);
 
+        // the code an earlier build generated before optimizing it, for classes no change can affect
+        char code_path[1024];
+        build_code_path(code_path, sizeof(code_path), dir_name, program_file->d_name);
+        if (incremental == TRUE && is_file_affected(program_file->d_name) == FALSE && copy_file(code_path, output_file_path) == TRUE) {
+            add_vm_file(&program, output_file_path);
+            continue;
+        }
+
+        unsigned long long key = use_cache == TRUE ? class_cache_key(file_to_be_compiled) : 0;
+        if (key != 0 && fetch_cached_class(key, output_file_path) == TRUE) {
+            if (incremental == TRUE) {
+                copy_file(output_file_path, code_path);
+            }
+            add_vm_file(&program, output_file_path);
+            continue;
+        }
+
         // parse individual file, return error in error exists
         int init_parser = InitParser(file_to_be_compiled);
         if (init_parser == 0) {
+            is_codegen = FALSE;
+            closedir(dir);
+            close_class_cache();
+            discard_build_manifest();
+            free_vm_program(&program);
             parser_info.er = lexerErr;
             return parser_info;
         }
         parser_info = Parse();
         StopParser();
-        if (parser_info.er != none) {
+        if (parser_info.er != none || compile_failure == TRUE) {
+            is_codegen = FALSE;
+            closedir(dir);
+            close_class_cache();
+            discard_build_manifest();
+            free_vm_program(&program);
             return parser_info;
         }
+        if (key != 0) {
+            store_cached_class(key, output_file_path);
+        }
+        if (incremental == TRUE) {
+            copy_file(output_file_path, code_path);
+        }
+        add_vm_file(&program, output_file_path);
     }
 
     is_codegen = FALSE;
     closedir(dir);
+    close_class_cache();
+    if (incremental == TRUE) {
+        write_build_manifest(dir_name);
+    }
+
+    optimize_program(&program);
+    free_vm_program(&program);
 
     parser_info.er = none;
     return parser_info;
 }
 
 int StopCompiler() {
+    free_profile();
     return stop_symbol();  // return 1
 }
\ No newline at end of file
@@ -37,10 +37,36 @@ typedef enum {
     CONST_SEG,
 } MemorySegment;
 
+typedef struct {
+    int tree_shaking;   // drop functions unreachable from Sys.init / Main.main
+    int inline_budget;  // largest leaf function inlined at its call sites, 0 disables inlining
+    int tail_calls;     // self-recursive tail calls become a jump to the function entry
+    int optimize;       // run the subroutine passes over each function's control-flow graph
+    int dump_ir;        // write every class's control-flow graph to Class.ir next to Class.vm
+    int level;          // 0 generates code as parsed, 1 adds the cheap cleanups, 2 runs every pass
+    int time_passes;    // report time spent and instructions removed by every pass
+    char* profile;      // execution profile guiding inlining and layout, NULL for none
+    int folding;        // merge identical functions of different names and redirect their callers
+    int intrinsics;     // expand Memory.peek/poke, Math.abs/min/max and Array.new in place of calling the OS
+    char* cache_dir;    // content-addressed cache of every class's generated code, NULL for none
+    long cache_limit;   // bytes the cache directory may hold before the least recently used entries go
+    int incremental;    // only check and generate the classes a change since the last build can affect
+    int watch;          // keep rebuilding the program directory whenever one of its classes is saved
+    int report;         // print what inlining, tree shaking, folding and the subroutine passes changed
+} CompilerOptions;
+
 int InitCompiler();
 ParserInfo compile(char* dir_name);
+ParserInfo load_library(char* dir_name, unsigned long long library_hash);
 int StopCompiler();
 int is_codegen_phase();
-FILE* get_output_file();
+void set_resident_compiler(int resident);
+int has_compile_failed();
+void fail_compile();  // a file the build can not use, exits unless the compiler is resident
+void print_compile_error(ParserInfo parser_info);
+FILE* get_output_file();  // NULL when a resident compiler could not open it
+CompilerOptions* get_compiler_options();
+void set_optimization_level(int level);
+int set_compiler_flag(char* flag);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include "daemon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compiler.h"
+#include "ir.h"
+
+#define TRUE 1
+#define FALSE 0
+
+int write_fully(int fd, void *data, long size) {
+    char *bytes = (char *)data;
+    while (size > 0) {
+        long written = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return FALSE;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return TRUE;
+}
+
+int read_fully(int fd, void *data, long size) {
+    char *bytes = (char *)data;
+    while (size > 0) {
+        long count = read(fd, bytes, size);
+        if (count <= 0) {
+            return FALSE;
+        }
+        bytes += count;
+        size -= count;
+    }
+    return TRUE;
+}
+
+int daemon_address(char *socket_path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        printf("socket path %s is too long\n", socket_path);
+        return FALSE;
+    }
+    strcpy(address->sun_path, socket_path);
+    return TRUE;
+}
+
+// -1 when no daemon listens on the socket
+int connect_to_daemon(char *socket_path) {
+    struct sockaddr_un address;
+    if (daemon_address(socket_path, &address) == FALSE) {
+        return -1;
+    }
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0) {
+        return -1;
+    }
+    if (connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(connection);
+        return -1;
+    }
+    return connection;
+}
+
+// the options every request starts from, a request's flags only hold for that request
+CompilerOptions daemon_options;
+
+// run one request with the compiler's output going to a temporary file, status as the compiler would exit with
+int serve_compile(DaemonRequest *request, DaemonResponse *response) {
+    *get_compiler_options() = daemon_options;
+    enable_ir_passes(daemon_options.level);
+    for (int i = 0; i < request->flag_count && i < DAEMON_MAX_FLAGS; i++) {
+        request->flags[i][sizeof(request->flags[i]) - 1] = '\0';
+        if (set_compiler_flag(request->flags[i]) == FALSE) {
+            return 1;
+        }
+    }
+    // a request is answered once its build is done
+    if (get_compiler_options()->watch == TRUE) {
+        printf("the daemon does not serve --watch\n");
+        return 1;
+    }
+
+    response->result = compile(request->dir_name);
+    return has_compile_failed() == TRUE;
+}
+
+void serve_request(int connection, DaemonRequest *request) {
+    DaemonResponse response;
+    memset(&response, 0, sizeof(response));
+    request->cwd[sizeof(request->cwd) - 1] = '\0';
+    request->dir_name[sizeof(request->dir_name) - 1] = '\0';
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // everything printed while compiling goes back to the client
+    FILE *output = tmpfile();
+    if (output == NULL) {
+        printf("daemon: can not capture compiler output\n");
+        return;
+    }
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(output), STDOUT_FILENO);
+    if (chdir(request->cwd) != 0) {
+        printf("Directory %s does not exist.\n", request->cwd);
+        response.status = 1;
+    } else {
+        response.status = serve_compile(request, &response);
+    }
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    *get_compiler_options() = daemon_options;
+
+    response.output_size = ftell(output);
+    rewind(output);
+    int sent = write_fully(connection, &response, sizeof(response));
+    char buffer[8192];
+    size_t size;
+    while (sent == TRUE && (size = fread(buffer, 1, sizeof(buffer), output)) > 0) {
+        sent = write_fully(connection, buffer, size);
+    }
+    fclose(output);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    printf("daemon: %s/%s %s in %.3f ms\n", request->cwd, request->dir_name,
+           response.status != 0 || response.result.er != none ? "failed" : "compiled", elapsed);
+}
+
+// serve requests one at a time until a client asks the daemon to stop, FALSE when it could not start
+int run_compiler_daemon(char *socket_path) {
+    struct sockaddr_un address;
+    if (daemon_address(socket_path, &address) == FALSE) {
+        return FALSE;
+    }
+    int running = connect_to_daemon(socket_path);
+    if (running >= 0) {
+        close(running);
+        printf("a daemon already listens on %s\n", socket_path);
+        return FALSE;
+    }
+    // the socket of a daemon that did not stop cleanly
+    unlink(socket_path);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || bind(server, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(server, 16) != 0) {
+        printf("can not listen on %s\n", socket_path);
+        if (server >= 0) {
+            close(server);
+        }
+        return FALSE;
+    }
+
+    char cwd[512];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        cwd[0] = '\0';
+    }
+    daemon_options = *get_compiler_options();
+    // a directory or file the compiler can not use fails the request instead of stopping the daemon
+    set_resident_compiler(TRUE);
+    SetTokenCaching(TRUE);
+    printf("daemon: listening on %s\n", socket_path);
+    fflush(stdout);
+
+    int stopping = FALSE;
+    while (stopping == FALSE) {
+        int connection = accept(server, NULL, NULL);
+        if (connection < 0) {
+            continue;
+        }
+        DaemonRequest request;
+        if (read_fully(connection, &request, sizeof(request)) == TRUE) {
+            if (request.kind == DAEMON_STOP) {
+                DaemonResponse response;
+                memset(&response, 0, sizeof(response));
+                write_fully(connection, &response, sizeof(response));
+                stopping = TRUE;
+            } else {
+                serve_request(connection, &request);
+            }
+        }
+        close(connection);
+        fflush(stdout);
+    }
+
+    close(server);
+    // relative socket paths are relative to where the daemon started
+    if (cwd[0] != '\0' && chdir(cwd) == 0) {
+        unlink(socket_path);
+    }
+    SetTokenCaching(FALSE);
+    set_resident_compiler(FALSE);
+    printf("daemon: stopped\n");
+    return TRUE;
+}
+
+// compile on the daemon, with its output printed here, FALSE when no daemon answered and nothing was compiled;
+// like compile() this exits when the compiler would
+int request_compile(char *socket_path, char *dir_name, char **flags, int flag_count, ParserInfo *result) {
+    DaemonRequest request;
+    memset(&request, 0, sizeof(request));
+    request.kind = DAEMON_COMPILE;
+    if (getcwd(request.cwd, sizeof(request.cwd)) == NULL || strlen(dir_name) >= sizeof(request.dir_name) ||
+        flag_count > DAEMON_MAX_FLAGS) {
+        return FALSE;
+    }
+    strcpy(request.dir_name, dir_name);
+    for (int i = 0; i < flag_count; i++) {
+        if (strlen(flags[i]) >= sizeof(request.flags[i])) {
+            return FALSE;
+        }
+        strcpy(request.flags[i], flags[i]);
+    }
+    request.flag_count = flag_count;
+
+    int connection = connect_to_daemon(socket_path);
+    if (connection < 0) {
+        return FALSE;
+    }
+    DaemonResponse response;
+    if (write_fully(connection, &request, sizeof(request)) == FALSE || read_fully(connection, &response, sizeof(response)) == FALSE) {
+        close(connection);
+        return FALSE;
+    }
+
+    char buffer[8192];
+    long remaining = response.output_size;
+    while (remaining > 0) {
+        long count = read(connection, buffer, remaining < (long)sizeof(buffer) ? remaining : (long)sizeof(buffer));
+        if (count <= 0) {
+            break;
+        }
+        fwrite(buffer, 1, count, stdout);
+        remaining -= count;
+    }
+    close(connection);
+    fflush(stdout);
+    if (response.status != 0) {
+        exit(response.status);
+    }
+    *result = response.result;
+    return TRUE;
+}
+
+int stop_compiler_daemon(char *socket_path) {
+    int connection = connect_to_daemon(socket_path);
+    if (connection < 0) {
+        printf("no daemon listens on %s\n", socket_path);
+        return FALSE;
+    }
+    DaemonRequest request;
+    memset(&request, 0, sizeof(request));
+    request.kind = DAEMON_STOP;
+    DaemonResponse response;
+    int ok = write_fully(connection, &request, sizeof(request)) == TRUE && read_fully(connection, &response, sizeof(response)) == TRUE;
+    close(connection);
+    return ok;
+}
@@ -0,0 +1,35 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "parser.h"
+
+// a resident compiler serving compile requests over a unix domain socket, the library tables and the tokens
+// of every file it lexed stay in memory between requests, a thin client forwards its build and prints the result
+
+#define DAEMON_SOCKET "jackc.sock"
+#define DAEMON_MAX_FLAGS 16
+
+typedef enum {
+    DAEMON_COMPILE,
+    DAEMON_STOP
+} DaemonRequestKind;
+
+typedef struct {
+    DaemonRequestKind kind;
+    char cwd[512];       // the client's working directory, which holds the library
+    char dir_name[512];  // as the client would pass it to compile()
+    int flag_count;
+    char flags[DAEMON_MAX_FLAGS][128];
+} DaemonRequest;
+
+typedef struct {
+    ParserInfo result;  // what compile() returned
+    int status;         // non zero when the compiler would have exited with it instead of returning
+    long output_size;   // bytes the compiler printed, they follow the response
+} DaemonResponse;
+
+int run_compiler_daemon(char *socket_path);
+int request_compile(char *socket_path, char *dir_name, char **flags, int flag_count, ParserInfo *result);
+int stop_compiler_daemon(char *socket_path);
+
+#endif
@@ -0,0 +1,457 @@
+#include "hack.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRUE 1
+#define FALSE 0
+
+FILE *asm_file;
+int rom_words = 0;
+int return_label_idx = 0;
+int compare_label_idx = 0;
+HackOptimization hack_mode = OPTIMIZE_SPEED;
+
+// which shared routines have to be appended to the program
+int uses_call_routine = FALSE;
+int uses_return_routine = FALSE;
+int uses_compare_routine[3] = {FALSE, FALSE, FALSE};
+
+char *compare_routines[] = {"$$EQ", "$$GT", "$$LT"};
+char *compare_jumps[] = {"JEQ", "JGT", "JLT"};
+
+char current_function[VM_NAME_LEN];
+
+// write one line of assembly, labels in parentheses take no ROM space
+void emit(char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(asm_file, format, args);
+    va_end(args);
+    fputc('\n', asm_file);
+
+    if (format[0] != '(') {
+        rom_words += 1;
+    }
+}
+
+void emit_push_d() {
+    emit("@SP");
+    emit("AM=M+1");
+    emit("A=A-1");
+    emit("M=D");
+}
+
+void emit_pop_d() {
+    emit("@SP");
+    emit("AM=M-1");
+    emit("D=M");
+}
+
+char *segment_base(MemorySegment seg) {
+    switch (seg) {
+        case LOCAL_SEG:
+            return "LCL";
+        case ARGUMENT_SEG:
+            return "ARG";
+        case THIS_SEG:
+            return "THIS";
+        case THAT_SEG:
+            return "THAT";
+        default:
+            return NULL;
+    }
+}
+
+void emit_push(VmFile *file, VmInstruction *instruction) {
+    int idx = instruction->idx;
+    char *base = segment_base(instruction->seg);
+
+    if (base != NULL) {
+        emit("@%s", base);
+        if (idx == 0) {
+            emit("A=M");
+        } else if (idx == 1) {
+            emit("A=M+1");
+        } else {
+            emit("D=M");
+            emit("@%d", idx);
+            emit("A=D+A");
+        }
+        emit("D=M");
+    } else if (instruction->seg == CONST_SEG) {
+        if (idx == 0 || idx == 1) {
+            emit("D=%d", idx);
+        } else {
+            emit("@%d", idx);
+            emit("D=A");
+        }
+    } else if (instruction->seg == POINTER_SEG) {
+        emit(idx == 0 ? "@THIS" : "@THAT");
+        emit("D=M");
+    } else if (instruction->seg == TEMP_SEG) {
+        emit("@R%d", 5 + idx);
+        emit("D=M");
+    } else {
+        emit("@%s.%d", file->class_name, idx);
+        emit("D=M");
+    }
+    emit_push_d();
+}
+
+void emit_pop(VmFile *file, VmInstruction *instruction) {
+    int idx = instruction->idx;
+    char *base = segment_base(instruction->seg);
+
+    if (base != NULL && idx > 6) {
+        // compute the address first, the stack top is popped afterwards
+        emit("@%s", base);
+        emit("D=M");
+        emit("@%d", idx);
+        emit("D=D+A");
+        emit("@R13");
+        emit("M=D");
+        emit_pop_d();
+        emit("@R13");
+        emit("A=M");
+        emit("M=D");
+        return;
+    }
+
+    emit_pop_d();
+    if (base != NULL) {
+        emit("@%s", base);
+        emit("A=M");
+        for (int i = 0; i < idx; i++) {
+            emit("A=A+1");
+        }
+    } else if (instruction->seg == POINTER_SEG) {
+        emit(idx == 0 ? "@THIS" : "@THAT");
+    } else if (instruction->seg == TEMP_SEG) {
+        emit("@R%d", 5 + idx);
+    } else if (instruction->seg == STATIC_SEG) {
+        emit("@%s.%d", file->class_name, idx);
+    } else {
+        printf("can not pop into constant segment\n");
+        exit(1);
+    }
+    emit("M=D");
+}
+
+void emit_compare(VmCommand cmd) {
+    int which = cmd - EQ_CM;
+
+    if (hack_mode == OPTIMIZE_SIZE) {
+        uses_compare_routine[which] = TRUE;
+        emit("@$$RET.%d", return_label_idx);
+        emit("D=A");
+        emit("@%s", compare_routines[which]);
+        emit("0;JMP");
+        emit("($$RET.%d)", return_label_idx);
+        return_label_idx += 1;
+        return;
+    }
+
+    emit("@SP");
+    emit("AM=M-1");
+    emit("D=M");
+    emit("A=A-1");
+    emit("D=M-D");
+    emit("M=-1");
+    emit("@$$CMP.%d", compare_label_idx);
+    emit("D;%s", compare_jumps[which]);
+    emit("@SP");
+    emit("A=M-1");
+    emit("M=0");
+    emit("($$CMP.%d)", compare_label_idx);
+    compare_label_idx += 1;
+}
+
+void emit_function(VmInstruction *instruction) {
+    strncpy(current_function, instruction->name, VM_NAME_LEN);
+    emit("(%s)", instruction->name);
+
+    // zero the locals with a single stack pointer update
+    int locals = instruction->idx;
+    if (locals > 0) {
+        emit("@SP");
+        emit("A=M");
+        emit("M=0");
+        for (int i = 1; i < locals; i++) {
+            emit("A=A+1");
+            emit("M=0");
+        }
+        emit("D=A+1");
+        emit("@SP");
+        emit("M=D");
+    }
+}
+
+void emit_call(char *function_name, int args) {
+    int label = return_label_idx;
+    return_label_idx += 1;
+
+    if (hack_mode == OPTIMIZE_SIZE) {
+        uses_call_routine = TRUE;
+        emit("@%s", function_name);
+        emit("D=A");
+        emit("@R13");
+        emit("M=D");
+        emit("@%d", args);
+        emit("D=A");
+        emit("@R14");
+        emit("M=D");
+        emit("@$$RET.%d", label);
+        emit("D=A");
+        emit("@$$CALL");
+        emit("0;JMP");
+        emit("($$RET.%d)", label);
+        return;
+    }
+
+    emit("@$$RET.%d", label);
+    emit("D=A");
+    emit_push_d();
+    char *saved[] = {"LCL", "ARG", "THIS", "THAT"};
+    for (int i = 0; i < 4; i++) {
+        emit("@%s", saved[i]);
+        emit("D=M");
+        emit_push_d();
+    }
+    emit("@SP");
+    emit("D=M");
+    emit("@%d", args + 5);
+    emit("D=D-A");
+    emit("@ARG");
+    emit("M=D");
+    emit("@SP");
+    emit("D=M");
+    emit("@LCL");
+    emit("M=D");
+    emit("@%s", function_name);
+    emit("0;JMP");
+    emit("($$RET.%d)", label);
+}
+
+void emit_return_body() {
+    // R13 = frame, R14 = return address
+    emit("@LCL");
+    emit("D=M");
+    emit("@R13");
+    emit("M=D");
+    emit("@5");
+    emit("A=D-A");
+    emit("D=M");
+    emit("@R14");
+    emit("M=D");
+    emit_pop_d();
+    emit("@ARG");
+    emit("A=M");
+    emit("M=D");
+    emit("@ARG");
+    emit("D=M+1");
+    emit("@SP");
+    emit("M=D");
+    char *restored[] = {"THAT", "THIS", "ARG", "LCL"};
+    for (int i = 0; i < 4; i++) {
+        emit("@R13");
+        emit("AM=M-1");
+        emit("D=M");
+        emit("@%s", restored[i]);
+        emit("M=D");
+    }
+    emit("@R14");
+    emit("A=M");
+    emit("0;JMP");
+}
+
+void emit_return() {
+    if (hack_mode == OPTIMIZE_SIZE) {
+        uses_return_routine = TRUE;
+        emit("@$$RETURN");
+        emit("0;JMP");
+        return;
+    }
+    emit_return_body();
+}
+
+void emit_instruction(VmFile *file, VmInstruction *instruction) {
+    switch (instruction->cmd) {
+        case ADD_CM:
+        case SUB_CM:
+        case AND_CM:
+        case OR_CM:
+            emit_pop_d();
+            emit("A=A-1");
+            if (instruction->cmd == ADD_CM) {
+                emit("M=D+M");
+            } else if (instruction->cmd == SUB_CM) {
+                emit("M=M-D");
+            } else if (instruction->cmd == AND_CM) {
+                emit("M=D&M");
+            } else {
+                emit("M=D|M");
+            }
+            break;
+        case NEG_CM:
+        case NOT_CM:
+            emit("@SP");
+            emit("A=M-1");
+            emit(instruction->cmd == NEG_CM ? "M=-M" : "M=!M");
+            break;
+        case EQ_CM:
+        case GT_CM:
+        case LT_CM:
+            emit_compare(instruction->cmd);
+            break;
+        case PUSH_CM:
+            emit_push(file, instruction);
+            break;
+        case POP_CM:
+            emit_pop(file, instruction);
+            break;
+        case LABEL_CM:
+            emit("(%s$%s)", current_function, instruction->name);
+            break;
+        case GOTO_CM:
+            emit("@%s$%s", current_function, instruction->name);
+            emit("0;JMP");
+            break;
+        case IF_GOTO_CM:
+            emit_pop_d();
+            emit("@%s$%s", current_function, instruction->name);
+            emit("D;JNE");
+            break;
+        case FUNCTION_CM:
+            emit_function(instruction);
+            break;
+        case CALL_CM:
+            emit_call(instruction->name, instruction->idx);
+            break;
+        case RETURN_CM:
+            emit_return();
+            break;
+    }
+}
+
+// shared routines reached by computed jumps, the return address is in D or R13/R14
+void emit_shared_routines() {
+    if (uses_call_routine == TRUE) {
+        // D = return address, R13 = callee, R14 = number of arguments
+        emit("($$CALL)");
+        emit_push_d();
+        char *saved[] = {"LCL", "ARG", "THIS", "THAT"};
+        for (int i = 0; i < 4; i++) {
+            emit("@%s", saved[i]);
+            emit("D=M");
+            emit_push_d();
+        }
+        emit("@R14");
+        emit("D=M");
+        emit("@5");
+        emit("D=D+A");
+        emit("@SP");
+        emit("D=M-D");
+        emit("@ARG");
+        emit("M=D");
+        emit("@SP");
+        emit("D=M");
+        emit("@LCL");
+        emit("M=D");
+        emit("@R13");
+        emit("A=M");
+        emit("0;JMP");
+    }
+
+    if (uses_return_routine == TRUE) {
+        emit("($$RETURN)");
+        emit_return_body();
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (uses_compare_routine[i] == FALSE) {
+            continue;
+        }
+        // D = return address
+        emit("(%s)", compare_routines[i]);
+        emit("@R13");
+        emit("M=D");
+        emit("@SP");
+        emit("AM=M-1");
+        emit("D=M");
+        emit("A=A-1");
+        emit("D=M-D");
+        emit("M=-1");
+        emit("@%s.TRUE", compare_routines[i]);
+        emit("D;%s", compare_jumps[i]);
+        emit("@SP");
+        emit("A=M-1");
+        emit("M=0");
+        emit("(%s.TRUE)", compare_routines[i]);
+        emit("@R13");
+        emit("A=M");
+        emit("0;JMP");
+    }
+}
+
+int has_function(VmProgram *program, char *name) {
+    for (int i = 0; i < program->size; i++) {
+        VmFile *file = &program->files[i];
+        for (int j = 0; j < file->size; j++) {
+            if (file->code[j].cmd == FUNCTION_CM && strcmp(file->code[j].name, name) == 0) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+int translate_to_hack(VmProgram *program, char *output_path, HackOptimization mode) {
+    asm_file = fopen(output_path, "w");
+    if (asm_file == NULL) {
+        printf("error when trying to create or open the assembly file path\n");
+        return FALSE;
+    }
+
+    hack_mode = mode;
+    rom_words = 0;
+    return_label_idx = 0;
+    compare_label_idx = 0;
+    uses_call_routine = FALSE;
+    uses_return_routine = FALSE;
+    for (int i = 0; i < 3; i++) {
+        uses_compare_routine[i] = FALSE;
+    }
+    strcpy(current_function, "");
+
+    // bootstrap only when the OS entry point is part of the program
+    if (has_function(program, "Sys.init") == TRUE) {
+        emit("@256");
+        emit("D=A");
+        emit("@SP");
+        emit("M=D");
+        emit_call("Sys.init", 0);
+        emit("($$HALT)");
+        emit("@$$HALT");
+        emit("0;JMP");
+    }
+
+    for (int i = 0; i < program->size; i++) {
+        VmFile *file = &program->files[i];
+        for (int j = 0; j < file->size; j++) {
+            emit_instruction(file, &file->code[j]);
+        }
+    }
+
+    emit_shared_routines();
+    fclose(asm_file);
+    asm_file = NULL;
+
+    printf("%s: %d ROM words\n", output_path, rom_words);
+    if (rom_words > HACK_ROM_SIZE) {
+        printf("warning: program does not fit in the %d word ROM\n", HACK_ROM_SIZE);
+    }
+    return TRUE;
+}
@@ -0,0 +1,17 @@
+#ifndef HACK_H
+#define HACK_H
+
+#include "vmcode.h"
+
+#define HACK_ROM_SIZE 32768
+
+// OPTIMIZE_SPEED inlines every call, return and comparison sequence
+// OPTIMIZE_SIZE routes them through shared routines emitted once per program
+typedef enum {
+    OPTIMIZE_SPEED,
+    OPTIMIZE_SIZE
+} HackOptimization;
+
+int translate_to_hack(VmProgram *program, char *output_path, HackOptimization mode);
+
+#endif
@@ -0,0 +1,226 @@
+#include "interface.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dirent.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// 64 bit FNV-1a, continue a running hash by passing it back in
+unsigned long long hash_bytes(unsigned long long hash, const void *data, long size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (long i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// every library .jack file of the directory, names and contents, independent of the order readdir lists them in
+unsigned long long library_source_hash(char *dir_name) {
+    DIR *dir = opendir(dir_name);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    unsigned long long total = 0;
+    struct dirent *entry;
+    char path[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strstr(entry->d_name, ".jack") == NULL) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir_name, entry->d_name);
+        FILE *file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+
+        unsigned long long hash = hash_bytes(14695981039346656037ull, entry->d_name, strlen(entry->d_name) + 1);
+        char buffer[4096];
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            hash = hash_bytes(hash, buffer, size);
+        }
+        fclose(file);
+        total += hash;
+    }
+    closedir(dir);
+    return total;
+}
+
+// records and strings are collected in memory, the string offsets are only known once both are complete
+typedef struct {
+    InterfaceRecord *records;
+    int record_count;
+    int record_capacity;
+    char *strings;
+    int string_size;
+    int string_capacity;
+} InterfaceBuffer;
+
+int add_interface_string(InterfaceBuffer *buffer, char *text) {
+    int length = strlen(text) + 1;
+    while (buffer->string_size + length > buffer->string_capacity) {
+        buffer->string_capacity *= 2;
+        buffer->strings = (char *)realloc(buffer->strings, buffer->string_capacity);
+    }
+    int offset = buffer->string_size;
+    memcpy(buffer->strings + offset, text, length);
+    buffer->string_size += length;
+    return offset;
+}
+
+int add_interface_record(InterfaceBuffer *buffer, TableRow *row, int parent) {
+    if (buffer->record_count == buffer->record_capacity) {
+        buffer->record_capacity *= 2;
+        buffer->records = (InterfaceRecord *)realloc(buffer->records, sizeof(InterfaceRecord) * buffer->record_capacity);
+    }
+    InterfaceRecord *record = &buffer->records[buffer->record_count];
+    memset(record, 0, sizeof(InterfaceRecord));
+    record->name = add_interface_string(buffer, row->token.lx);
+    record->type = add_interface_string(buffer, row->type);
+    // the lexer fills the file name without a terminator when it is 32 characters long
+    char file[sizeof(row->token.fl) + 1];
+    memcpy(file, row->token.fl, sizeof(row->token.fl));
+    file[sizeof(row->token.fl)] = '\0';
+    record->file = add_interface_string(buffer, file);
+    record->line = row->token.ln;
+    record->kind = row->kind;
+    record->stack_idx = row->stack_idx;
+    record->parent = parent;
+    record->has_table = row->child_table != NULL;
+    if (row->child_table != NULL) {
+        memcpy(record->symbol_kind_cnt, row->child_table->symbol_kind_cnt, sizeof(record->symbol_kind_cnt));
+    }
+    buffer->record_count += 1;
+    return buffer->record_count - 1;
+}
+
+// the program table as it stands, i.e. right after the library classes were parsed
+int write_interface(char *path, unsigned long long source_hash) {
+    InterfaceBuffer buffer;
+    buffer.record_count = 0;
+    buffer.record_capacity = 256;
+    buffer.records = (InterfaceRecord *)malloc(sizeof(InterfaceRecord) * buffer.record_capacity);
+    buffer.string_size = 0;
+    buffer.string_capacity = 4096;
+    buffer.strings = (char *)malloc(buffer.string_capacity);
+
+    // classes, each followed by its members, each member by its own table
+    SymbolTable *program_table = get_program_table();
+    for (int i = 0; i < program_table->size; i++) {
+        TableRow *class = program_table->rows[i];
+        int class_record = add_interface_record(&buffer, class, -1);
+        for (int j = 0; class->child_table != NULL && j < class->child_table->size; j++) {
+            TableRow *member = class->child_table->rows[j];
+            int member_record = add_interface_record(&buffer, member, class_record);
+            for (int k = 0; member->child_table != NULL && k < member->child_table->size; k++) {
+                add_interface_record(&buffer, member->child_table->rows[k], member_record);
+            }
+        }
+    }
+
+    InterfaceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "JIF", 4);
+    header.version = INTERFACE_VERSION;
+    header.record_size = sizeof(InterfaceRecord);
+    header.record_count = buffer.record_count;
+    header.string_size = buffer.string_size;
+    header.source_hash = source_hash;
+
+    // written under a temporary name, a concurrent build never maps half a file
+    char temporary[512];
+    snprintf(temporary, sizeof(temporary), "%s.%d", path, (int)getpid());
+    FILE *file = fopen(temporary, "wb");
+    int ok = file != NULL;
+    if (ok == TRUE) {
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(buffer.records, sizeof(InterfaceRecord), buffer.record_count, file);
+        fwrite(buffer.strings, 1, buffer.string_size, file);
+        ok = fclose(file) == 0 && rename(temporary, path) == 0;
+    }
+    if (ok == FALSE) {
+        printf("can not write interface file %s\n", path);
+        remove(temporary);
+    }
+    free(buffer.records);
+    free(buffer.strings);
+    return ok;
+}
+
+// FALSE when the file is missing, from another compiler version or built from other sources
+int load_interface(char *path, unsigned long long source_hash) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return FALSE;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (long)sizeof(InterfaceHeader)) {
+        close(fd);
+        return FALSE;
+    }
+    void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return FALSE;
+    }
+
+    InterfaceHeader *header = (InterfaceHeader *)map;
+    if (memcmp(header->magic, "JIF", 4) != 0 || header->version != INTERFACE_VERSION || header->record_size != sizeof(InterfaceRecord) ||
+        header->source_hash != source_hash ||
+        info.st_size != (long)(sizeof(InterfaceHeader) + header->record_count * sizeof(InterfaceRecord) + header->string_size)) {
+        munmap(map, info.st_size);
+        return FALSE;
+    }
+
+    // records are read in place, only the tables they describe are allocated
+    InterfaceRecord *records = (InterfaceRecord *)(header + 1);
+    char *strings = (char *)(records + header->record_count);
+    int valid = header->string_size > 0 && strings[header->string_size - 1] == '\0';
+    for (int i = 0; valid == TRUE && i < header->record_count; i++) {
+        InterfaceRecord *record = &records[i];
+        valid = record->parent < i && (record->parent < 0 || records[record->parent].has_table == TRUE) &&
+                record->name >= 0 && record->name < header->string_size && record->type >= 0 && record->type < header->string_size &&
+                record->file >= 0 && record->file < header->string_size && record->kind >= CLASS && record->kind <= ARGS;
+    }
+    if (valid == FALSE) {
+        munmap(map, info.st_size);
+        return FALSE;
+    }
+    SymbolTable **tables = (SymbolTable **)malloc(sizeof(SymbolTable *) * (header->record_count + 1));
+    for (int i = 0; i < header->record_count; i++) {
+        InterfaceRecord *record = &records[i];
+        SymbolTable *parent = record->parent < 0 ? get_program_table() : tables[record->parent];
+        tables[i] = NULL;
+        if (record->has_table == TRUE) {
+            tables[i] = create_table(record->parent < 0 ? CLASS_SCOPE : METHOD_SCOPE, strings + record->name);
+        }
+
+        Token token;
+        token.tp = ID;
+        token.ec = NoLexErr;
+        token.ln = record->line;
+        snprintf(token.lx, sizeof(token.lx), "%s", strings + record->name);
+        snprintf(token.fl, sizeof(token.fl), "%s", strings + record->file);
+        if (insert_symbol_into_table(parent, tables[i], record->kind, token, strings + record->type) == FALSE) {
+            parent->rows[parent->size - 1]->stack_idx = record->stack_idx;
+        }
+    }
+    for (int i = 0; i < header->record_count; i++) {
+        if (tables[i] != NULL) {
+            memcpy(tables[i]->symbol_kind_cnt, records[i].symbol_kind_cnt, sizeof(records[i].symbol_kind_cnt));
+        }
+    }
+
+    free(tables);
+    munmap(map, info.st_size);
+    return TRUE;
+}
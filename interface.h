@@ -0,0 +1,40 @@
+#ifndef INTERFACE_H
+#define INTERFACE_H
+
+#include "symbols.h"
+
+// precompiled symbol tables of the library classes, loaded in place of parsing their sources
+
+#define INTERFACE_FILE "library.jif"
+#define INTERFACE_VERSION 1
+
+// fixed size header at the start of the file, followed by the records and then their strings
+typedef struct {
+    char magic[4];                   // "JIF\0"
+    int version;                     // INTERFACE_VERSION
+    int record_size;                 // sizeof(InterfaceRecord), guards against layout changes
+    int record_count;
+    int string_size;                 // bytes of NUL terminated strings after the records
+    int reserved;
+    unsigned long long source_hash;  // library_source_hash() of the sources the tables came from
+} InterfaceHeader;
+
+// one row of a symbol table, in the order it was inserted, a table's rows follow its owner
+typedef struct {
+    int name;                // offsets into the strings
+    int type;
+    int file;
+    int line;
+    int kind;                // SymbolKind
+    int stack_idx;
+    int parent;              // record owning the table this row is in, -1 for the program table
+    int has_table;           // classes and subroutines own a table of their own
+    int symbol_kind_cnt[8];  // counts of that table
+} InterfaceRecord;
+
+unsigned long long hash_bytes(unsigned long long hash, const void *data, long size);
+unsigned long long library_source_hash(char *dir_name);
+int write_interface(char *path, unsigned long long source_hash);
+int load_interface(char *path, unsigned long long source_hash);
+
+#endif
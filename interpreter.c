@@ -0,0 +1,926 @@
+#include "interpreter.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jit.h"
+#include "natives.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// handler addresses of the dispatch loop, filled in by the first call of execute()
+const void **handler_table = NULL;
+const void *profile_handler = NULL;
+
+char *decoded_op_names[] = {
+    "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not",
+    "push constant", "push local", "push argument", "push this", "push that",
+    "push pointer 0", "push pointer 1", "push static/temp",
+    "pop local", "pop argument", "pop this", "pop that",
+    "pop pointer 0", "pop pointer 1", "pop static/temp",
+    "goto", "if-goto", "call", "native", "function", "return", "halt",
+    "add constant", "array load", "load offset", "array store", "inc local",
+    "if-not-goto", "if-eq-goto", "if-gt-goto", "if-lt-goto"};
+
+typedef struct {
+    char name[VM_NAME_LEN];
+    int pc;
+} LabelEntry;
+
+typedef struct {
+    int pc;
+    char name[VM_NAME_LEN];
+} Fixup;
+
+int execute(Interpreter *vm, int start_pc, long long max_steps);
+
+int init_interpreter(Interpreter *vm) {
+    vm->size = 0;
+    vm->capacity = 1024;
+    vm->code = (DecodedInstruction *)malloc(sizeof(DecodedInstruction) * vm->capacity);
+    vm->function_count = 0;
+    vm->function_capacity = 64;
+    vm->functions = (DecodedFunction *)malloc(sizeof(DecodedFunction) * vm->function_capacity);
+    vm->frames = (Frame *)malloc(sizeof(Frame) * MAX_FRAMES);
+    memset(vm->ram, 0, sizeof(vm->ram));
+    vm->steps = 0;
+    vm->result = 0;
+    vm->use_natives = TRUE;
+    vm->fuse = TRUE;
+    vm->pair_counts = NULL;
+    vm->jit = NULL;
+    vm->profile = NULL;
+    reset_natives(vm);
+
+    if (handler_table == NULL) {
+        execute(NULL, 0, 0);
+    }
+    return 1;
+}
+
+void stop_interpreter(Interpreter *vm) {
+    stop_jit(vm);
+    free(vm->code);
+    free(vm->functions);
+    free(vm->frames);
+    free(vm->pair_counts);
+    if (vm->profile != NULL) {
+        free(vm->profile->counts);
+        free(vm->profile->taken);
+        free(vm->profile->labels);
+        free(vm->profile->branches);
+        free(vm->profile);
+        vm->profile = NULL;
+    }
+    vm->code = NULL;
+    vm->functions = NULL;
+    vm->frames = NULL;
+    vm->pair_counts = NULL;
+}
+
+// count executed opcode pairs on the plain instruction stream, call before load_interpreter()
+void collect_pair_statistics(Interpreter *vm) {
+    vm->fuse = FALSE;
+    vm->pair_counts = calloc(OP_COUNT, sizeof(*vm->pair_counts));
+}
+
+void print_pair_statistics(Interpreter *vm, FILE *stream, int top) {
+    if (vm->pair_counts == NULL) {
+        return;
+    }
+
+    // repeatedly pick the largest remaining pair, top is small
+    char *printed = calloc(OP_COUNT * OP_COUNT, sizeof(char));
+    for (int n = 0; n < top; n++) {
+        int best = -1;
+        for (int i = 0; i < OP_COUNT * OP_COUNT; i++) {
+            if (printed[i] == FALSE && vm->pair_counts[i / OP_COUNT][i % OP_COUNT] > 0 &&
+                (best < 0 || vm->pair_counts[i / OP_COUNT][i % OP_COUNT] > vm->pair_counts[best / OP_COUNT][best % OP_COUNT])) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        printed[best] = TRUE;
+        fprintf(stream, "%12lld  %s -> %s\n", vm->pair_counts[best / OP_COUNT][best % OP_COUNT],
+                decoded_op_names[best / OP_COUNT], decoded_op_names[best % OP_COUNT]);
+    }
+    free(printed);
+}
+
+// count executed instructions and taken branches on the plain instruction stream, call before load_interpreter()
+void collect_execution_profile(Interpreter *vm) {
+    vm->fuse = FALSE;
+    vm->profile = (ExecutionProfile *)calloc(1, sizeof(ExecutionProfile));
+}
+
+void add_profile_label(ProfileLabel *labels, int *count, int pc, char *name) {
+    labels[*count].pc = pc;
+    snprintf(labels[*count].name, VM_NAME_LEN, "%s", name);
+    *count += 1;
+}
+
+// one line per function, label and if-goto: "function Class.sub calls", "block Class.sub label count",
+// "branch Class.sub target executed taken"
+int write_execution_profile(Interpreter *vm, char *path) {
+    if (vm->profile == NULL || vm->profile->counts == NULL) {
+        printf("no execution profile was collected\n");
+        return FALSE;
+    }
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        printf("can not write profile %s\n", path);
+        return FALSE;
+    }
+
+    ExecutionProfile *profile = vm->profile;
+    int label = 0;
+    int branch = 0;
+    for (int i = 0; i < vm->function_count; i++) {
+        DecodedFunction *function = &vm->functions[i];
+        int end = i + 1 < vm->function_count ? vm->functions[i + 1].entry : vm->size;
+        fprintf(file, "function %s %lld\n", function->name, profile->counts[function->entry]);
+        for (; label < profile->label_count && profile->labels[label].pc < end; label++) {
+            fprintf(file, "block %s %s %lld\n", function->name, profile->labels[label].name, profile->counts[profile->labels[label].pc]);
+        }
+        for (; branch < profile->branch_count && profile->branches[branch].pc < end; branch++) {
+            int pc = profile->branches[branch].pc;
+            fprintf(file, "branch %s %s %lld %lld\n", function->name, profile->branches[branch].name, profile->counts[pc], profile->taken[pc]);
+        }
+    }
+    fclose(file);
+    return TRUE;
+}
+
+int emit_decoded(Interpreter *vm, int op, int arg, int arg2) {
+    if (vm->size == vm->capacity) {
+        vm->capacity *= 2;
+        vm->code = (DecodedInstruction *)realloc(vm->code, sizeof(DecodedInstruction) * vm->capacity);
+    }
+    DecodedInstruction *instruction = &vm->code[vm->size];
+    instruction->handler = handler_table[op];
+    instruction->op = op;
+    instruction->arg = arg;
+    instruction->arg2 = arg2;
+    vm->size += 1;
+    return vm->size - 1;
+}
+
+int find_function(Interpreter *vm, char *name) {
+    for (int i = 0; i < vm->function_count; i++) {
+        if (strcmp(vm->functions[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int add_function(Interpreter *vm, char *name, int entry) {
+    if (find_function(vm, name) >= 0) {
+        printf("duplicate function %s\n", name);
+        return FALSE;
+    }
+    if (vm->function_count == vm->function_capacity) {
+        vm->function_capacity *= 2;
+        vm->functions = (DecodedFunction *)realloc(vm->functions, sizeof(DecodedFunction) * vm->function_capacity);
+    }
+    snprintf(vm->functions[vm->function_count].name, VM_NAME_LEN, "%s", name);
+    vm->functions[vm->function_count].entry = entry;
+    vm->function_count += 1;
+    return TRUE;
+}
+
+int decode_push(MemorySegment seg, int idx, int static_base, int *op, int *arg) {
+    *arg = idx;
+    switch (seg) {
+        case CONST_SEG:
+            *op = OP_PUSH_CONST;
+            break;
+        case LOCAL_SEG:
+            *op = OP_PUSH_LOCAL;
+            break;
+        case ARGUMENT_SEG:
+            *op = OP_PUSH_ARG;
+            break;
+        case THIS_SEG:
+            *op = OP_PUSH_THIS;
+            break;
+        case THAT_SEG:
+            *op = OP_PUSH_THAT;
+            break;
+        case POINTER_SEG:
+            *op = idx == 0 ? OP_PUSH_POINTER0 : OP_PUSH_POINTER1;
+            break;
+        case TEMP_SEG:
+            *op = OP_PUSH_RAM;
+            *arg = 5 + idx;
+            break;
+        case STATIC_SEG:
+            *op = OP_PUSH_RAM;
+            *arg = static_base + idx;
+            break;
+    }
+    return TRUE;
+}
+
+int decode_pop(MemorySegment seg, int idx, int static_base, int *op, int *arg) {
+    *arg = idx;
+    switch (seg) {
+        case LOCAL_SEG:
+            *op = OP_POP_LOCAL;
+            break;
+        case ARGUMENT_SEG:
+            *op = OP_POP_ARG;
+            break;
+        case THIS_SEG:
+            *op = OP_POP_THIS;
+            break;
+        case THAT_SEG:
+            *op = OP_POP_THAT;
+            break;
+        case POINTER_SEG:
+            *op = idx == 0 ? OP_POP_POINTER0 : OP_POP_POINTER1;
+            break;
+        case TEMP_SEG:
+            *op = OP_POP_RAM;
+            *arg = 5 + idx;
+            break;
+        case STATIC_SEG:
+            *op = OP_POP_RAM;
+            *arg = static_base + idx;
+            break;
+        default:
+            printf("can not pop into constant segment\n");
+            return FALSE;
+    }
+    return TRUE;
+}
+
+// resolve the gotos of one function once all its labels are known
+int resolve_labels(Interpreter *vm, LabelEntry *labels, int label_count, Fixup *jumps, int jump_count, char *function_name) {
+    for (int i = 0; i < jump_count; i++) {
+        int target = -1;
+        for (int j = 0; j < label_count; j++) {
+            if (strcmp(labels[j].name, jumps[i].name) == 0) {
+                target = labels[j].pc;
+                break;
+            }
+        }
+        if (target < 0) {
+            printf("undefined label %s in %s\n", jumps[i].name, function_name);
+            return FALSE;
+        }
+        vm->code[jumps[i].pc].arg = target;
+    }
+    return TRUE;
+}
+
+int is_instruction(VmFile *file, int j, VmCommand cmd) {
+    return j < file->size && file->code[j].cmd == cmd;
+}
+
+// idx < 0 matches any index
+int is_access(VmFile *file, int j, VmCommand cmd, MemorySegment seg, int idx) {
+    return is_instruction(file, j, cmd) && file->code[j].seg == seg && (idx < 0 || file->code[j].idx == idx);
+}
+
+// replace the sequence starting at j by one superinstruction, return the number of VM instructions
+// it covers or 0 when nothing matches. The sequences are the most frequent straight-line pairs and
+// chains reported by print_pair_statistics() on compiled Jack programs; a fused sequence never
+// contains a label, so no jump can land inside it
+int fuse_superinstruction(Interpreter *vm, VmFile *file, int j, Fixup *jump) {
+    VmInstruction *code = file->code;
+    jump->pc = -1;
+
+    if (is_access(file, j, PUSH_CM, LOCAL_SEG, -1) && is_access(file, j + 1, PUSH_CM, CONST_SEG, -1) &&
+        is_instruction(file, j + 2, ADD_CM) && is_access(file, j + 3, POP_CM, LOCAL_SEG, code[j].idx)) {
+        emit_decoded(vm, OP_INC_LOCAL, code[j].idx, code[j + 1].idx);
+        return 4;
+    }
+    if (is_access(file, j, PUSH_CM, CONST_SEG, -1) && is_instruction(file, j + 1, ADD_CM) &&
+        is_access(file, j + 2, POP_CM, POINTER_SEG, 1) && is_access(file, j + 3, PUSH_CM, THAT_SEG, 0)) {
+        emit_decoded(vm, OP_LOAD_OFFSET, code[j].idx, 0);
+        return 4;
+    }
+    if (is_access(file, j, POP_CM, TEMP_SEG, 0) && is_access(file, j + 1, POP_CM, POINTER_SEG, 1) &&
+        is_access(file, j + 2, PUSH_CM, TEMP_SEG, 0) && is_access(file, j + 3, POP_CM, THAT_SEG, 0)) {
+        emit_decoded(vm, OP_ARRAY_STORE, 0, 0);
+        return 4;
+    }
+    if (is_instruction(file, j, ADD_CM) && is_access(file, j + 1, POP_CM, POINTER_SEG, 1) &&
+        is_access(file, j + 2, PUSH_CM, THAT_SEG, 0)) {
+        emit_decoded(vm, OP_ARRAY_LOAD, 0, 0);
+        return 3;
+    }
+    if (is_access(file, j, PUSH_CM, CONST_SEG, -1) && is_instruction(file, j + 1, ADD_CM)) {
+        emit_decoded(vm, OP_ADD_CONST, code[j].idx, 0);
+        return 2;
+    }
+    if (is_instruction(file, j + 1, IF_GOTO_CM)) {
+        int op = -1;
+        if (code[j].cmd == NOT_CM) {
+            op = OP_IF_NOT_GOTO;
+        } else if (code[j].cmd == EQ_CM) {
+            op = OP_IF_EQ_GOTO;
+        } else if (code[j].cmd == GT_CM) {
+            op = OP_IF_GT_GOTO;
+        } else if (code[j].cmd == LT_CM) {
+            op = OP_IF_LT_GOTO;
+        }
+        if (op >= 0) {
+            strncpy(jump->name, code[j + 1].name, VM_NAME_LEN);
+            jump->pc = emit_decoded(vm, op, 0, 0);
+            return 2;
+        }
+    }
+    return 0;
+}
+
+// pre-decode the program into a compact array with resolved labels, statics and calls
+int load_interpreter(Interpreter *vm, VmProgram *program) {
+    int static_base = STATIC_BASE;
+    int total = count_vm_instructions(program);
+
+    LabelEntry *labels = (LabelEntry *)malloc(sizeof(LabelEntry) * (total + 1));
+    Fixup *jumps = (Fixup *)malloc(sizeof(Fixup) * (total + 1));
+    Fixup *calls = (Fixup *)malloc(sizeof(Fixup) * (total + 1));
+    int call_count = 0;
+    int ok = TRUE;
+    if (vm->profile != NULL) {
+        vm->profile->labels = (ProfileLabel *)malloc(sizeof(ProfileLabel) * (total + 1));
+        vm->profile->branches = (ProfileLabel *)malloc(sizeof(ProfileLabel) * (total + 1));
+    }
+
+    for (int i = 0; i < program->size && ok == TRUE; i++) {
+        VmFile *file = &program->files[i];
+        int label_count = 0;
+        int jump_count = 0;
+        char function_name[VM_NAME_LEN] = "";
+
+        // statics of every class get their own slice of RAM[16..255]
+        int statics = 0;
+        for (int j = 0; j < file->size; j++) {
+            VmInstruction *instruction = &file->code[j];
+            if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == STATIC_SEG && instruction->idx + 1 > statics) {
+                statics = instruction->idx + 1;
+            }
+        }
+        if (static_base + statics > STATIC_LIMIT) {
+            printf("too many static variables in %s\n", file->path);
+            ok = FALSE;
+            break;
+        }
+
+        for (int j = 0; j < file->size && ok == TRUE; j++) {
+            VmInstruction *instruction = &file->code[j];
+            int op = 0;
+            int arg = 0;
+
+            if (instruction->cmd != FUNCTION_CM && function_name[0] == '\0') {
+                printf("%s: instruction outside of a function\n", file->path);
+                ok = FALSE;
+                break;
+            }
+
+            if (vm->fuse == TRUE) {
+                int fused = fuse_superinstruction(vm, file, j, &jumps[jump_count]);
+                if (fused > 0) {
+                    if (jumps[jump_count].pc >= 0) {
+                        jump_count += 1;
+                    }
+                    j += fused - 1;
+                    continue;
+                }
+            }
+
+            switch (instruction->cmd) {
+                case FUNCTION_CM:
+                    if (function_name[0] != '\0') {
+                        ok = resolve_labels(vm, labels, label_count, jumps, jump_count, function_name);
+                    }
+                    label_count = 0;
+                    jump_count = 0;
+                    strncpy(function_name, instruction->name, VM_NAME_LEN);
+                    if (ok == TRUE) {
+                        ok = add_function(vm, instruction->name, vm->size);
+                    }
+                    emit_decoded(vm, OP_ENTER, vm->function_count - 1, instruction->idx);
+                    break;
+                case PUSH_CM:
+                    decode_push(instruction->seg, instruction->idx, static_base, &op, &arg);
+                    emit_decoded(vm, op, arg, 0);
+                    break;
+                case POP_CM:
+                    ok = decode_pop(instruction->seg, instruction->idx, static_base, &op, &arg);
+                    emit_decoded(vm, op, arg, 0);
+                    break;
+                case LABEL_CM:
+                    for (int k = 0; k < label_count; k++) {
+                        if (strcmp(labels[k].name, instruction->name) == 0) {
+                            printf("duplicate label %s in %s\n", instruction->name, function_name);
+                            ok = FALSE;
+                        }
+                    }
+                    strncpy(labels[label_count].name, instruction->name, VM_NAME_LEN);
+                    labels[label_count].pc = vm->size;
+                    label_count += 1;
+                    if (vm->profile != NULL) {
+                        add_profile_label(vm->profile->labels, &vm->profile->label_count, vm->size, instruction->name);
+                    }
+                    break;
+                case GOTO_CM:
+                case IF_GOTO_CM:
+                    strncpy(jumps[jump_count].name, instruction->name, VM_NAME_LEN);
+                    jumps[jump_count].pc = emit_decoded(vm, instruction->cmd == GOTO_CM ? OP_GOTO : OP_IF_GOTO, 0, 0);
+                    if (vm->profile != NULL && instruction->cmd == IF_GOTO_CM) {
+                        add_profile_label(vm->profile->branches, &vm->profile->branch_count, jumps[jump_count].pc, instruction->name);
+                    }
+                    jump_count += 1;
+                    break;
+                case CALL_CM:
+                    strncpy(calls[call_count].name, instruction->name, VM_NAME_LEN);
+                    calls[call_count].pc = emit_decoded(vm, OP_CALL, 0, instruction->idx);
+                    call_count += 1;
+                    break;
+                case RETURN_CM:
+                    emit_decoded(vm, OP_RETURN, 0, 0);
+                    break;
+                default:
+                    // arithmetic and logical commands map one to one
+                    emit_decoded(vm, OP_ADD + instruction->cmd - ADD_CM, 0, 0);
+                    break;
+            }
+        }
+
+        if (ok == TRUE && function_name[0] != '\0') {
+            ok = resolve_labels(vm, labels, label_count, jumps, jump_count, function_name);
+        }
+        static_base += statics;
+    }
+
+    for (int i = 0; i < call_count && ok == TRUE; i++) {
+        DecodedInstruction *call = &vm->code[calls[i].pc];
+
+        // OS entry points run natively unless the Jack versions are being verified
+        int native = vm->use_natives == TRUE ? find_native(calls[i].name) : -1;
+        if (native >= 0) {
+            if (get_native(native)->args != call->arg2) {
+                printf("%s expects %d arguments\n", calls[i].name, get_native(native)->args);
+                ok = FALSE;
+                break;
+            }
+            call->op = OP_NATIVE;
+            call->handler = handler_table[OP_NATIVE];
+            call->arg = native;
+            continue;
+        }
+
+        int function = find_function(vm, calls[i].name);
+        if (function < 0) {
+            printf("undefined function %s\n", calls[i].name);
+            ok = FALSE;
+            break;
+        }
+        call->arg = vm->functions[function].entry;
+    }
+
+    // returning from the entry function lands here
+    emit_decoded(vm, OP_HALT, 0, 0);
+
+    if (vm->profile != NULL) {
+        vm->profile->counts = (long long *)calloc(vm->size, sizeof(long long));
+        vm->profile->taken = (long long *)calloc(vm->size, sizeof(long long));
+    }
+    if (vm->pair_counts != NULL || vm->profile != NULL) {
+        for (int i = 0; i < vm->size; i++) {
+            vm->code[i].handler = profile_handler;
+        }
+    }
+
+    free(labels);
+    free(jumps);
+    free(calls);
+    return ok;
+}
+
+int run_interpreter(Interpreter *vm, char *entry, long long max_steps) {
+    int function = find_function(vm, entry);
+    if (function < 0) {
+        printf("entry function %s not found\n", entry);
+        return FALSE;
+    }
+
+    vm->ram[0] = STACK_BASE;
+    vm->ram[1] = STACK_BASE;
+    vm->ram[2] = STACK_BASE;
+    vm->ram[3] = 0;
+    vm->ram[4] = 0;
+    vm->steps = 0;
+    reset_natives(vm);
+    int status = execute(vm, vm->functions[function].entry, max_steps);
+    return vm->faulted == TRUE ? FALSE : status;
+}
+
+#if defined(__GNUC__)
+#define DISPATCH() goto *ip->handler
+#define DISPATCH_OP() goto *handlers[ip->op]
+#else
+#define DISPATCH() goto dispatch
+#define DISPATCH_OP() goto dispatch_op
+#endif
+
+#define NEXT()      \
+    do {            \
+        steps += 1; \
+        ip += 1;    \
+        DISPATCH(); \
+    } while (0)
+
+#define JUMP(target)                 \
+    do {                             \
+        steps += 1;                  \
+        ip = code + (target);        \
+        if (steps >= step_limit) {   \
+            goto out_of_steps;       \
+        }                            \
+        DISPATCH();                  \
+    } while (0)
+
+// superinstructions count every VM instruction they stand for
+#define NEXT_FUSED(count)         \
+    do {                          \
+        steps += (count) - 1;     \
+        NEXT();                   \
+    } while (0)
+
+#define JUMP_FUSED(count, target)  \
+    do {                           \
+        steps += (count) - 1;      \
+        JUMP(target);              \
+    } while (0)
+
+// the dispatch loop, called once with vm == NULL to publish the handler addresses
+int execute(Interpreter *vm, int start_pc, long long max_steps) {
+#if defined(__GNUC__)
+    static const void *handlers[OP_COUNT + 1] = {
+        &&op_add, &&op_sub, &&op_neg, &&op_eq, &&op_gt, &&op_lt, &&op_and, &&op_or, &&op_not,
+        &&op_push_const, &&op_push_local, &&op_push_arg, &&op_push_this, &&op_push_that,
+        &&op_push_pointer0, &&op_push_pointer1, &&op_push_ram,
+        &&op_pop_local, &&op_pop_arg, &&op_pop_this, &&op_pop_that,
+        &&op_pop_pointer0, &&op_pop_pointer1, &&op_pop_ram,
+        &&op_goto, &&op_if_goto, &&op_call, &&op_native, &&op_enter, &&op_return, &&op_halt,
+        &&op_add_const, &&op_array_load, &&op_load_offset, &&op_array_store, &&op_inc_local,
+        &&op_if_not_goto, &&op_if_eq_goto, &&op_if_gt_goto, &&op_if_lt_goto, &&op_profile};
+#else
+    static const void *handlers[OP_COUNT + 1];
+#endif
+
+    if (vm == NULL) {
+        handler_table = handlers;
+        profile_handler = handlers[OP_COUNT];
+        return TRUE;
+    }
+
+    DecodedInstruction *code = vm->code;
+    DecodedInstruction *ip = code + start_pc;
+    int16_t *ram = vm->ram;
+    Frame *frames = vm->frames;
+    long long steps = 0;
+    long long step_limit = max_steps > 0 ? max_steps : LLONG_MAX;
+    int fp = 0;
+    int sp = ram[0];
+    int lcl = ram[1];
+    int arg = ram[2];
+    int this = ram[3];
+    int that = ram[4];
+    int status = TRUE;
+    DecodedInstruction *last_ip = NULL;
+    JitEntry entry = NULL;
+
+    // the entry function is called with no arguments and returns into OP_HALT
+    frames[0].return_pc = vm->size - 1;
+    frames[0].lcl = lcl;
+    frames[0].arg = arg;
+    frames[0].this = this;
+    frames[0].that = that;
+    fp = 1;
+    arg = sp;
+    lcl = sp;
+    DISPATCH();
+
+#if !defined(__GNUC__)
+dispatch:
+    if (vm->pair_counts != NULL || vm->profile != NULL) {
+        goto op_profile;
+    }
+dispatch_op:
+    switch (ip->op) {
+        case OP_ADD: goto op_add;
+        case OP_SUB: goto op_sub;
+        case OP_NEG: goto op_neg;
+        case OP_EQ: goto op_eq;
+        case OP_GT: goto op_gt;
+        case OP_LT: goto op_lt;
+        case OP_AND: goto op_and;
+        case OP_OR: goto op_or;
+        case OP_NOT: goto op_not;
+        case OP_PUSH_CONST: goto op_push_const;
+        case OP_PUSH_LOCAL: goto op_push_local;
+        case OP_PUSH_ARG: goto op_push_arg;
+        case OP_PUSH_THIS: goto op_push_this;
+        case OP_PUSH_THAT: goto op_push_that;
+        case OP_PUSH_POINTER0: goto op_push_pointer0;
+        case OP_PUSH_POINTER1: goto op_push_pointer1;
+        case OP_PUSH_RAM: goto op_push_ram;
+        case OP_POP_LOCAL: goto op_pop_local;
+        case OP_POP_ARG: goto op_pop_arg;
+        case OP_POP_THIS: goto op_pop_this;
+        case OP_POP_THAT: goto op_pop_that;
+        case OP_POP_POINTER0: goto op_pop_pointer0;
+        case OP_POP_POINTER1: goto op_pop_pointer1;
+        case OP_POP_RAM: goto op_pop_ram;
+        case OP_GOTO: goto op_goto;
+        case OP_IF_GOTO: goto op_if_goto;
+        case OP_CALL: goto op_call;
+        case OP_NATIVE: goto op_native;
+        case OP_ENTER: goto op_enter;
+        case OP_RETURN: goto op_return;
+        case OP_ADD_CONST: goto op_add_const;
+        case OP_ARRAY_LOAD: goto op_array_load;
+        case OP_LOAD_OFFSET: goto op_load_offset;
+        case OP_ARRAY_STORE: goto op_array_store;
+        case OP_INC_LOCAL: goto op_inc_local;
+        case OP_IF_NOT_GOTO: goto op_if_not_goto;
+        case OP_IF_EQ_GOTO: goto op_if_eq_goto;
+        case OP_IF_GT_GOTO: goto op_if_gt_goto;
+        case OP_IF_LT_GOTO: goto op_if_lt_goto;
+        default: goto op_halt;
+    }
+#endif
+
+op_add:
+    sp -= 1;
+    ram[sp - 1] = ram[sp - 1] + ram[sp];
+    NEXT();
+op_sub:
+    sp -= 1;
+    ram[sp - 1] = ram[sp - 1] - ram[sp];
+    NEXT();
+op_neg:
+    ram[sp - 1] = -ram[sp - 1];
+    NEXT();
+op_eq:
+    sp -= 1;
+    ram[sp - 1] = ram[sp - 1] == ram[sp] ? -1 : 0;
+    NEXT();
+op_gt:
+    sp -= 1;
+    ram[sp - 1] = ram[sp - 1] > ram[sp] ? -1 : 0;
+    NEXT();
+op_lt:
+    sp -= 1;
+    ram[sp - 1] = ram[sp - 1] < ram[sp] ? -1 : 0;
+    NEXT();
+op_and:
+    sp -= 1;
+    ram[sp - 1] = ram[sp - 1] & ram[sp];
+    NEXT();
+op_or:
+    sp -= 1;
+    ram[sp - 1] = ram[sp - 1] | ram[sp];
+    NEXT();
+op_not:
+    ram[sp - 1] = ~ram[sp - 1];
+    NEXT();
+op_push_const:
+    ram[sp] = ip->arg;
+    sp += 1;
+    NEXT();
+op_push_local:
+    ram[sp] = ram[lcl + ip->arg];
+    sp += 1;
+    NEXT();
+op_push_arg:
+    ram[sp] = ram[arg + ip->arg];
+    sp += 1;
+    NEXT();
+op_push_this:
+    ram[sp] = ram[(this + ip->arg) & RAM_MASK];
+    sp += 1;
+    NEXT();
+op_push_that:
+    ram[sp] = ram[(that + ip->arg) & RAM_MASK];
+    sp += 1;
+    NEXT();
+op_push_pointer0:
+    ram[sp] = this;
+    sp += 1;
+    NEXT();
+op_push_pointer1:
+    ram[sp] = that;
+    sp += 1;
+    NEXT();
+op_push_ram:
+    ram[sp] = ram[ip->arg];
+    sp += 1;
+    NEXT();
+op_pop_local:
+    sp -= 1;
+    ram[lcl + ip->arg] = ram[sp];
+    NEXT();
+op_pop_arg:
+    sp -= 1;
+    ram[arg + ip->arg] = ram[sp];
+    NEXT();
+op_pop_this:
+    sp -= 1;
+    ram[(this + ip->arg) & RAM_MASK] = ram[sp];
+    NEXT();
+op_pop_that:
+    sp -= 1;
+    ram[(that + ip->arg) & RAM_MASK] = ram[sp];
+    NEXT();
+op_pop_pointer0:
+    sp -= 1;
+    this = ram[sp];
+    NEXT();
+op_pop_pointer1:
+    sp -= 1;
+    that = ram[sp];
+    NEXT();
+op_pop_ram:
+    sp -= 1;
+    ram[ip->arg] = ram[sp];
+    NEXT();
+op_goto:
+    JUMP(ip->arg);
+op_if_goto:
+    sp -= 1;
+    if (ram[sp] != 0) {
+        JUMP(ip->arg);
+    }
+    NEXT();
+op_call:
+    if (fp == MAX_FRAMES) {
+        printf("call stack overflow\n");
+        status = FALSE;
+        goto done;
+    }
+    frames[fp].return_pc = (int)(ip - code) + 1;
+    frames[fp].lcl = lcl;
+    frames[fp].arg = arg;
+    frames[fp].this = this;
+    frames[fp].that = that;
+    fp += 1;
+    arg = sp - ip->arg2;
+    lcl = sp;
+    JUMP(ip->arg);
+op_native:
+    sp -= ip->arg2;
+    ram[sp] = get_native(ip->arg)->function(vm, ram + sp);
+    sp += 1;
+    if (vm->halted == TRUE) {
+        goto done;
+    }
+    NEXT();
+op_enter:
+    if (sp + ip->arg2 >= HEAP_BASE) {
+        printf("stack overflow\n");
+        status = FALSE;
+        goto done;
+    }
+    for (int i = 0; i < ip->arg2; i++) {
+        ram[sp] = 0;
+        sp += 1;
+    }
+    if (vm->jit != NULL) {
+        entry = jit_function_entry(vm, ip->arg);
+        if (entry != NULL) {
+            steps += 1;
+            goto jit_enter;
+        }
+    }
+    NEXT();
+op_return:
+    ram[arg] = ram[sp - 1];
+    sp = arg + 1;
+    fp -= 1;
+    lcl = frames[fp].lcl;
+    arg = frames[fp].arg;
+    this = frames[fp].this;
+    that = frames[fp].that;
+    if (vm->jit != NULL) {
+        entry = jit_entry_at(vm, frames[fp].return_pc);
+        if (entry != NULL) {
+            steps += 1;
+            goto jit_enter;
+        }
+    }
+    JUMP(frames[fp].return_pc);
+op_halt:
+    vm->result = ram[sp - 1];
+    goto done;
+op_add_const:
+    ram[sp - 1] = ram[sp - 1] + ip->arg;
+    NEXT_FUSED(2);
+op_array_load:
+    sp -= 1;
+    that = ram[sp - 1] + ram[sp];
+    ram[sp - 1] = ram[that & RAM_MASK];
+    NEXT_FUSED(3);
+op_load_offset:
+    that = ram[sp - 1] + ip->arg;
+    ram[sp - 1] = ram[that & RAM_MASK];
+    NEXT_FUSED(4);
+op_array_store:
+    sp -= 2;
+    that = ram[sp];
+    ram[5] = ram[sp + 1];
+    ram[that & RAM_MASK] = ram[sp + 1];
+    NEXT_FUSED(4);
+op_inc_local:
+    ram[lcl + ip->arg] = ram[lcl + ip->arg] + ip->arg2;
+    NEXT_FUSED(4);
+op_if_not_goto:
+    sp -= 1;
+    if (ram[sp] != -1) {
+        JUMP_FUSED(2, ip->arg);
+    }
+    NEXT_FUSED(2);
+op_if_eq_goto:
+    sp -= 2;
+    if (ram[sp] == ram[sp + 1]) {
+        JUMP_FUSED(2, ip->arg);
+    }
+    NEXT_FUSED(2);
+op_if_gt_goto:
+    sp -= 2;
+    if (ram[sp] > ram[sp + 1]) {
+        JUMP_FUSED(2, ip->arg);
+    }
+    NEXT_FUSED(2);
+op_if_lt_goto:
+    sp -= 2;
+    if (ram[sp] < ram[sp + 1]) {
+        JUMP_FUSED(2, ip->arg);
+    }
+    NEXT_FUSED(2);
+
+op_profile:
+    if (vm->profile != NULL) {
+        vm->profile->counts[ip - code] += 1;
+        if (ip->op == OP_IF_GOTO && ram[sp - 1] != 0) {
+            vm->profile->taken[ip - code] += 1;
+        }
+    }
+    // only straight-line successors can be fused, pairs across jumps are skipped
+    if (vm->pair_counts != NULL && last_ip != NULL && ip == last_ip + 1) {
+        vm->pair_counts[last_ip->op][ip->op] += 1;
+    }
+    last_ip = ip;
+    DISPATCH_OP();
+
+jit_enter: {
+    // compiled code runs until a call, return or unsupported instruction hands control back
+    JitContext *context = get_jit_context(vm);
+    context->sp = sp;
+    context->lcl = lcl;
+    context->arg = arg;
+    context->this = this;
+    context->that = that;
+    context->steps = 0;
+    context->budget = step_limit - steps;
+    int pc = entry(context);
+    sp = context->sp;
+    lcl = context->lcl;
+    arg = context->arg;
+    this = context->this;
+    that = context->that;
+    steps += context->steps;
+    if (vm->halted == TRUE) {
+        goto done;
+    }
+    if (steps >= step_limit) {
+        goto out_of_steps;
+    }
+    ip = code + pc;
+    DISPATCH();
+}
+
+out_of_steps:
+    printf("step limit of %lld instructions reached\n", max_steps);
+    status = FALSE;
+
+done:
+    ram[0] = sp;
+    ram[1] = lcl;
+    ram[2] = arg;
+    ram[3] = this;
+    ram[4] = that;
+    vm->steps = steps;
+    return status;
+}
@@ -0,0 +1,132 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <stdint.h>
+
+#include "vmcode.h"
+
+#define RAM_SIZE 32768
+#define RAM_MASK (RAM_SIZE - 1)
+#define STACK_BASE 256
+#define STATIC_BASE 16
+#define STATIC_LIMIT 256
+#define HEAP_BASE 2048
+#define MAX_FRAMES 65536
+
+// decoded opcodes, push and pop are specialised per segment
+typedef enum {
+    OP_ADD,
+    OP_SUB,
+    OP_NEG,
+    OP_EQ,
+    OP_GT,
+    OP_LT,
+    OP_AND,
+    OP_OR,
+    OP_NOT,
+    OP_PUSH_CONST,
+    OP_PUSH_LOCAL,
+    OP_PUSH_ARG,
+    OP_PUSH_THIS,
+    OP_PUSH_THAT,
+    OP_PUSH_POINTER0,
+    OP_PUSH_POINTER1,
+    OP_PUSH_RAM,  // static and temp, arg is the absolute address
+    OP_POP_LOCAL,
+    OP_POP_ARG,
+    OP_POP_THIS,
+    OP_POP_THAT,
+    OP_POP_POINTER0,
+    OP_POP_POINTER1,
+    OP_POP_RAM,
+    OP_GOTO,
+    OP_IF_GOTO,
+    OP_CALL,
+    OP_NATIVE,  // call of a built-in OS subroutine, arg is the native index
+    OP_ENTER,   // function entry, zeroes the locals, arg is the function index
+    OP_RETURN,
+    OP_HALT,
+    // superinstructions formed at decode time from frequent generated sequences
+    OP_ADD_CONST,      // push constant n; add
+    OP_ARRAY_LOAD,     // add; pop pointer 1; push that 0
+    OP_LOAD_OFFSET,    // push constant n; add; pop pointer 1; push that 0
+    OP_ARRAY_STORE,    // pop temp 0; pop pointer 1; push temp 0; pop that 0
+    OP_INC_LOCAL,      // push local i; push constant n; add; pop local i
+    OP_IF_NOT_GOTO,    // not; if-goto
+    OP_IF_EQ_GOTO,     // eq; if-goto
+    OP_IF_GT_GOTO,     // gt; if-goto
+    OP_IF_LT_GOTO,     // lt; if-goto
+    OP_COUNT
+} DecodedOp;
+
+// one pre-decoded instruction, labels are gone and every operand is resolved
+typedef struct {
+    const void *handler;  // threaded code, address of the handler in the dispatch loop
+    int op;
+    int arg;   // constant, absolute address, segment offset or jump target
+    int arg2;  // number of arguments of a call, number of locals of a function
+} DecodedInstruction;
+
+typedef struct {
+    char name[VM_NAME_LEN];
+    int entry;  // pc of the function's enter instruction
+} DecodedFunction;
+
+// a label or if-goto target of the loaded program, the profile is keyed by names not pcs
+typedef struct {
+    int pc;
+    char name[VM_NAME_LEN];
+} ProfileLabel;
+
+// per-instruction execution counts for profile-guided compilation
+typedef struct {
+    long long *counts;       // times every decoded instruction ran
+    long long *taken;        // times every if-goto jumped
+    ProfileLabel *labels;    // pc each label stands for, in pc order
+    int label_count;
+    ProfileLabel *branches;  // target label of every if-goto, in pc order
+    int branch_count;
+} ExecutionProfile;
+
+// saved caller state, kept off the VM stack so programs may exceed 32K instructions
+typedef struct {
+    int return_pc;
+    int lcl;
+    int arg;
+    int this;
+    int that;
+} Frame;
+
+typedef struct {
+    DecodedInstruction *code;
+    int size;
+    int capacity;
+    DecodedFunction *functions;
+    int function_count;
+    int function_capacity;
+    Frame *frames;
+    int16_t ram[RAM_SIZE];
+    long long steps;  // number of executed VM instructions
+    int result;       // value returned by the entry function
+    int use_natives;  // run OS subroutines natively instead of their Jack bodies
+    int halted;       // set by Sys.halt and Sys.error
+    int faulted;      // set when a native is handed an address outside RAM or the heap, fails the run
+    int heap_free;    // head of the native allocator's free list
+    int color;        // native Screen drawing color
+    int fuse;         // form superinstructions while decoding
+    long long (*pair_counts)[OP_COUNT];  // executed straight-line opcode pairs, NULL when not collected
+    struct Jit *jit;  // native code compiled on first call, NULL when every function is interpreted
+    ExecutionProfile *profile;  // NULL when not collected
+} Interpreter;
+
+int init_interpreter(Interpreter *vm);
+int load_interpreter(Interpreter *vm, VmProgram *program);
+int find_function(Interpreter *vm, char *name);
+int run_interpreter(Interpreter *vm, char *entry, long long max_steps);
+void stop_interpreter(Interpreter *vm);
+void collect_pair_statistics(Interpreter *vm);
+void print_pair_statistics(Interpreter *vm, FILE *stream, int top);
+void collect_execution_profile(Interpreter *vm);
+int write_execution_profile(Interpreter *vm, char *path);
+
+#endif
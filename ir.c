@@ -0,0 +1,559 @@
+#include "ir.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRUE 1
+#define FALSE 0
+
+IrPassEntry ir_passes[MAX_IR_PASSES];
+int ir_pass_count = 0;
+
+// values an instruction takes off the stack and puts back on it
+int stack_pops(VmInstruction *instruction) {
+    switch (instruction->cmd) {
+        case PUSH_CM:
+        case LABEL_CM:
+        case GOTO_CM:
+        case FUNCTION_CM:
+            return 0;
+        case POP_CM:
+        case IF_GOTO_CM:
+        case NEG_CM:
+        case NOT_CM:
+        case RETURN_CM:
+            return 1;
+        case CALL_CM:
+            return instruction->idx;
+        default:
+            return 2;
+    }
+}
+
+int stack_pushes(VmInstruction *instruction) {
+    switch (instruction->cmd) {
+        case POP_CM:
+        case LABEL_CM:
+        case GOTO_CM:
+        case IF_GOTO_CM:
+        case FUNCTION_CM:
+        case RETURN_CM:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+int ends_basic_block(VmInstruction *instruction) {
+    return instruction->cmd == GOTO_CM || instruction->cmd == IF_GOTO_CM || instruction->cmd == RETURN_CM;
+}
+
+int add_block(IrFunction *function) {
+    if (function->size == function->capacity) {
+        function->capacity *= 2;
+        function->blocks = (BasicBlock *)realloc(function->blocks, sizeof(BasicBlock) * function->capacity);
+    }
+
+    BasicBlock *block = &function->blocks[function->size];
+    block->label[0] = '\0';
+    block->size = 0;
+    block->capacity = 8;
+    block->code = (VmInstruction *)malloc(sizeof(VmInstruction) * block->capacity);
+    block->fallthrough = -1;
+    block->target = -1;
+    block->predecessors = NULL;
+    block->predecessor_count = 0;
+    block->idom = -1;
+    block->order = -1;
+    function->size += 1;
+    return function->size - 1;
+}
+
+// an empty block at position, the blocks from there on move up by one and edges are renumbered
+int insert_block(IrFunction *function, int position) {
+    int added = add_block(function);
+    BasicBlock block = function->blocks[added];
+    for (int i = added; i > position; i--) {
+        function->blocks[i] = function->blocks[i - 1];
+    }
+    function->blocks[position] = block;
+
+    for (int i = 0; i < function->size; i++) {
+        if (i == position) {
+            continue;
+        }
+        if (function->blocks[i].fallthrough >= position) {
+            function->blocks[i].fallthrough += 1;
+        }
+        if (function->blocks[i].target >= position) {
+            function->blocks[i].target += 1;
+        }
+    }
+    return position;
+}
+
+void add_block_instruction(BasicBlock *block, VmInstruction *instruction) {
+    if (block->size == block->capacity) {
+        block->capacity *= 2;
+        block->code = (VmInstruction *)realloc(block->code, sizeof(VmInstruction) * block->capacity);
+    }
+    block->code[block->size] = *instruction;
+    block->size += 1;
+}
+
+int find_block_label(IrFunction *function, char *label) {
+    for (int i = 0; i < function->size; i++) {
+        if (strcmp(function->blocks[i].label, label) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// give a block a label no other block of the function uses
+void new_block_label(IrFunction *function, int block) {
+    if (function->blocks[block].label[0] != '\0') {
+        return;
+    }
+    do {
+        snprintf(function->blocks[block].label, VM_NAME_LEN, "IR%d", function->next_label);
+        function->next_label += 1;
+    } while (find_block_label(function, function->blocks[block].label) != block);
+}
+
+// predecessors, dominators and the stack balance after blocks or edges changed
+void update_cfg(IrFunction *function) {
+    for (int i = 0; i < function->size; i++) {
+        free(function->blocks[i].predecessors);
+        function->blocks[i].predecessors = (int *)malloc(sizeof(int) * (function->size + 1));
+        function->blocks[i].predecessor_count = 0;
+    }
+    for (int i = 0; i < function->size; i++) {
+        int successors[2] = {function->blocks[i].fallthrough, function->blocks[i].target};
+        for (int k = 0; k < 2; k++) {
+            if (successors[k] < 0 || (k == 1 && successors[1] == successors[0])) {
+                continue;
+            }
+            BasicBlock *successor = &function->blocks[successors[k]];
+            successor->predecessors[successor->predecessor_count] = i;
+            successor->predecessor_count += 1;
+        }
+    }
+
+    function->balanced = TRUE;
+    for (int i = 0; i < function->size; i++) {
+        int depth = 0;
+        for (int j = 0; j < function->blocks[i].size; j++) {
+            VmInstruction *instruction = &function->blocks[i].code[j];
+            depth -= stack_pops(instruction);
+            if (depth < 0) {
+                function->balanced = FALSE;
+            }
+            depth += stack_pushes(instruction);
+        }
+        if (depth != 0) {
+            function->balanced = FALSE;
+        }
+    }
+
+    compute_dominators(function);
+}
+
+// split the instructions [start, end) of a file into basic blocks, FALSE when labels are ambiguous
+int build_ir_function(IrFunction *function, VmFile *file, int start, int end) {
+    function->header = file->code[start];
+    function->file = file;
+    function->size = 0;
+    function->capacity = 8;
+    function->blocks = (BasicBlock *)malloc(sizeof(BasicBlock) * function->capacity);
+    function->next_label = 0;
+
+    int current = add_block(function);
+    for (int j = start + 1; j < end; j++) {
+        VmInstruction *instruction = &file->code[j];
+        BasicBlock *block = &function->blocks[current];
+
+        if (instruction->cmd == LABEL_CM) {
+            if (block->size > 0 || block->label[0] != '\0' || current == 0) {
+                current = add_block(function);
+                block = &function->blocks[current];
+            }
+            if (find_block_label(function, instruction->name) >= 0) {
+                free_ir_function(function);
+                return FALSE;
+            }
+            strncpy(block->label, instruction->name, VM_NAME_LEN - 1);
+            block->label[VM_NAME_LEN - 1] = '\0';
+            continue;
+        }
+
+        add_block_instruction(block, instruction);
+        if (ends_basic_block(instruction) == TRUE && j + 1 < end) {
+            current = add_block(function);
+        }
+    }
+
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        VmInstruction *last = block->size > 0 ? &block->code[block->size - 1] : NULL;
+        if (last == NULL || (last->cmd != GOTO_CM && last->cmd != RETURN_CM)) {
+            block->fallthrough = i + 1 < function->size ? i + 1 : -1;
+        }
+        if (last != NULL && (last->cmd == GOTO_CM || last->cmd == IF_GOTO_CM)) {
+            block->target = find_block_label(function, last->name);
+            if (block->target < 0) {
+                free_ir_function(function);
+                return FALSE;
+            }
+        }
+    }
+
+    update_cfg(function);
+    return TRUE;
+}
+
+void free_ir_function(IrFunction *function) {
+    for (int i = 0; i < function->size; i++) {
+        free(function->blocks[i].code);
+        free(function->blocks[i].predecessors);
+    }
+    free(function->blocks);
+    function->blocks = NULL;
+    function->size = 0;
+}
+
+// blocks in their current order, with gotos added where a fall-through edge no longer falls through
+void lower_ir_function(IrFunction *function, VmFile *output) {
+    for (int i = 0; i < function->size; i++) {
+        int fallthrough = function->blocks[i].fallthrough;
+        if (fallthrough >= 0 && fallthrough != i + 1) {
+            new_block_label(function, fallthrough);
+        }
+    }
+
+    append_instruction(output, function->header);
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        if (block->label[0] != '\0') {
+            VmInstruction label;
+            label.cmd = LABEL_CM;
+            label.seg = CONST_SEG;
+            label.idx = 0;
+            strcpy(label.name, block->label);
+            append_instruction(output, label);
+        }
+        for (int j = 0; j < block->size; j++) {
+            append_instruction(output, block->code[j]);
+        }
+        if (block->fallthrough >= 0 && block->fallthrough != i + 1) {
+            VmInstruction jump;
+            jump.cmd = GOTO_CM;
+            jump.seg = CONST_SEG;
+            jump.idx = 0;
+            strcpy(jump.name, function->blocks[block->fallthrough].label);
+            append_instruction(output, jump);
+        }
+    }
+}
+
+int intersect_dominators(IrFunction *function, int a, int b) {
+    while (a != b) {
+        while (function->blocks[a].order > function->blocks[b].order) {
+            a = function->blocks[a].idom;
+        }
+        while (function->blocks[b].order > function->blocks[a].order) {
+            b = function->blocks[b].idom;
+        }
+    }
+    return a;
+}
+
+// iterative dominators over reverse postorder (Cooper, Harvey and Kennedy)
+void compute_dominators(IrFunction *function) {
+    int size = function->size;
+    int *postorder = (int *)malloc(sizeof(int) * size);
+    int *stack = (int *)malloc(sizeof(int) * size);
+    int *next_edge = (int *)malloc(sizeof(int) * size);
+    char *visited = (char *)calloc(size, sizeof(char));
+    int count = 0;
+
+    for (int i = 0; i < size; i++) {
+        function->blocks[i].order = -1;
+        function->blocks[i].idom = -1;
+    }
+
+    int top = 0;
+    stack[0] = 0;
+    next_edge[0] = 0;
+    visited[0] = TRUE;
+    while (top >= 0) {
+        int block = stack[top];
+        int successors[2] = {function->blocks[block].fallthrough, function->blocks[block].target};
+        if (next_edge[block] < 2) {
+            int successor = successors[next_edge[block]];
+            next_edge[block] += 1;
+            if (successor >= 0 && visited[successor] == FALSE) {
+                visited[successor] = TRUE;
+                top += 1;
+                stack[top] = successor;
+                next_edge[successor] = 0;
+            }
+            continue;
+        }
+        postorder[count] = block;
+        count += 1;
+        top -= 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        function->blocks[postorder[count - 1 - i]].order = i;
+    }
+
+    function->blocks[0].idom = 0;
+    int changed = TRUE;
+    while (changed == TRUE) {
+        changed = FALSE;
+        for (int i = count - 2; i >= 0; i--) {
+            int block = postorder[i];
+            int idom = -1;
+            for (int k = 0; k < function->blocks[block].predecessor_count; k++) {
+                int predecessor = function->blocks[block].predecessors[k];
+                if (function->blocks[predecessor].idom < 0) {
+                    continue;
+                }
+                idom = idom < 0 ? predecessor : intersect_dominators(function, predecessor, idom);
+            }
+            if (function->blocks[block].idom != idom) {
+                function->blocks[block].idom = idom;
+                changed = TRUE;
+            }
+        }
+    }
+    function->blocks[0].idom = -1;
+
+    free(postorder);
+    free(stack);
+    free(next_edge);
+    free(visited);
+}
+
+int dominates(IrFunction *function, int a, int b) {
+    if (function->blocks[b].order < 0) {
+        return FALSE;
+    }
+    while (b >= 0) {
+        if (b == a) {
+            return TRUE;
+        }
+        b = function->blocks[b].idom;
+    }
+    return FALSE;
+}
+
+int count_ir_instructions(IrFunction *function) {
+    int total = 0;
+    for (int i = 0; i < function->size; i++) {
+        total += function->blocks[i].size;
+    }
+    return total;
+}
+
+// removes blocks the entry can not reach, they are left over by the code generator and other passes
+int remove_unreachable_blocks(IrFunction *function) {
+    int *renumber = (int *)malloc(sizeof(int) * function->size);
+    int size = 0;
+    int removed = 0;
+
+    for (int i = 0; i < function->size; i++) {
+        if (function->blocks[i].order < 0) {
+            removed += function->blocks[i].size;
+            free(function->blocks[i].code);
+            free(function->blocks[i].predecessors);
+            renumber[i] = -1;
+            continue;
+        }
+        renumber[i] = size;
+        function->blocks[size] = function->blocks[i];
+        size += 1;
+    }
+    function->size = size;
+
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        block->fallthrough = block->fallthrough >= 0 ? renumber[block->fallthrough] : -1;
+        block->target = block->target >= 0 ? renumber[block->target] : -1;
+    }
+    free(renumber);
+
+    update_cfg(function);
+    return removed;
+}
+
+void dump_ir_function(IrFunction *function, FILE *stream) {
+    fprintf(stream, "function %s %d: %d blocks%s\n", function->header.name, function->header.idx, function->size,
+            function->balanced == TRUE ? "" : ", unbalanced stack");
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        fprintf(stream, "  b%d", i);
+        if (block->label[0] != '\0') {
+            fprintf(stream, " (%s)", block->label);
+        }
+        fprintf(stream, " preds:");
+        for (int k = 0; k < block->predecessor_count; k++) {
+            fprintf(stream, " b%d", block->predecessors[k]);
+        }
+        if (block->predecessor_count == 0) {
+            fprintf(stream, " -");
+        }
+        if (block->idom >= 0) {
+            fprintf(stream, " idom: b%d", block->idom);
+        } else {
+            fprintf(stream, " idom: -");
+        }
+        if (block->order < 0) {
+            fprintf(stream, " unreachable");
+        }
+        fprintf(stream, "\n");
+
+        for (int j = 0; j < block->size; j++) {
+            fprintf(stream, "    ");
+            print_instruction(stream, &block->code[j]);
+        }
+        if (block->target >= 0) {
+            fprintf(stream, "    -> b%d", block->target);
+            if (block->fallthrough >= 0) {
+                fprintf(stream, ", else b%d", block->fallthrough);
+            }
+            fprintf(stream, "\n");
+        } else if (block->fallthrough >= 0) {
+            fprintf(stream, "    -> b%d\n", block->fallthrough);
+        }
+    }
+}
+
+void add_ir_pass(char *name, IrPass run, int level) {
+    IrPassEntry *entry = find_ir_pass(name);
+    if (entry == NULL) {
+        if (ir_pass_count == MAX_IR_PASSES) {
+            printf("too many optimization passes\n");
+            exit(1);
+        }
+        entry = &ir_passes[ir_pass_count];
+        ir_pass_count += 1;
+    }
+    entry->name = name;
+    entry->run = run;
+    entry->level = level;
+    entry->enabled = TRUE;
+    entry->removed = 0;
+    entry->seconds = 0;
+}
+
+// the pipeline of an optimization level, individual passes can be switched afterwards
+void enable_ir_passes(int level) {
+    for (int i = 0; i < ir_pass_count; i++) {
+        ir_passes[i].enabled = ir_passes[i].level <= level;
+    }
+}
+
+void print_ir_pass_report(int timing) {
+    for (int i = 0; i < ir_pass_count; i++) {
+        IrPassEntry *entry = &ir_passes[i];
+        if (timing == TRUE && entry->enabled == TRUE) {
+            printf("optimization: %-12s %6d instructions removed %9.3f ms\n", entry->name, entry->removed, entry->seconds * 1000);
+        } else if (timing == FALSE && entry->removed > 0) {
+            printf("optimization: %s removed %d instructions\n", entry->name, entry->removed);
+        }
+    }
+}
+
+IrPassEntry *find_ir_pass(char *name) {
+    for (int i = 0; i < ir_pass_count; i++) {
+        if (strcmp(ir_passes[i].name, name) == 0) {
+            return &ir_passes[i];
+        }
+    }
+    return NULL;
+}
+
+// build the CFG of every function, run the enabled passes in order and lower back to VM code
+int run_ir_passes(VmProgram *program, int dump) {
+    int removed = 0;
+    for (int k = 0; k < ir_pass_count; k++) {
+        ir_passes[k].removed = 0;
+        ir_passes[k].seconds = 0;
+    }
+    for (int i = 0; i < program->size; i++) {
+        VmFile *file = &program->files[i];
+        VmFile output = *file;
+        output.size = 0;
+        output.capacity = file->size + 16;
+        output.code = (VmInstruction *)malloc(sizeof(VmInstruction) * output.capacity);
+
+        FILE *dump_file = NULL;
+        if (dump == TRUE) {
+            char path[VM_PATH_LEN];
+            strncpy(path, file->path, VM_PATH_LEN - 4);
+            path[VM_PATH_LEN - 4] = '\0';
+            char *dot = strrchr(path, '.');
+            if (dot != NULL) {
+                *dot = '\0';
+            }
+            strcat(path, ".ir");
+            dump_file = fopen(path, "w");
+        }
+
+        int j = 0;
+        while (j < file->size) {
+            if (file->code[j].cmd != FUNCTION_CM) {
+                append_instruction(&output, file->code[j]);
+                j += 1;
+                continue;
+            }
+            int end = j + 1;
+            while (end < file->size && file->code[end].cmd != FUNCTION_CM) {
+                end += 1;
+            }
+
+            // functions the CFG can not represent are kept as they are
+            IrFunction function;
+            if (build_ir_function(&function, file, j, end) == FALSE) {
+                for (int k = j; k < end; k++) {
+                    append_instruction(&output, file->code[k]);
+                }
+                j = end;
+                continue;
+            }
+
+            for (int k = 0; k < ir_pass_count; k++) {
+                if (ir_passes[k].enabled == FALSE) {
+                    continue;
+                }
+                clock_t start = clock();
+                int count = ir_passes[k].run(&function);
+                ir_passes[k].seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+                if (count > 0) {
+                    removed += count;
+                    ir_passes[k].removed += count;
+                }
+            }
+            if (dump_file != NULL) {
+                dump_ir_function(&function, dump_file);
+            }
+            lower_ir_function(&function, &output);
+            free_ir_function(&function);
+            j = end;
+        }
+
+        if (dump_file != NULL) {
+            fclose(dump_file);
+        }
+        free(file->code);
+        file->code = output.code;
+        file->size = output.size;
+        file->capacity = output.capacity;
+    }
+    return removed;
+}
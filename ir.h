@@ -0,0 +1,71 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+
+#include "vmcode.h"
+
+#define MAX_IR_PASSES 16
+
+// straight-line run of VM instructions, control only enters at the top and leaves at the bottom
+typedef struct {
+    char label[VM_NAME_LEN];  // label the block starts with, empty when it is only reached by falling through
+    VmInstruction *code;      // body without the label, a goto / if-goto / return can only be last
+    int size;
+    int capacity;
+    int fallthrough;  // block reached when the last instruction does not jump, -1 for none
+    int target;       // block a goto or if-goto jumps to, -1 for none
+    int *predecessors;
+    int predecessor_count;
+    int idom;   // immediate dominator, -1 for the entry block and unreachable blocks
+    int order;  // position in reverse postorder, -1 when unreachable
+} BasicBlock;
+
+// control-flow graph of one VM function
+typedef struct {
+    VmInstruction header;  // the function command
+    VmFile *file;          // class the function belongs to, statics are resolved per file
+    BasicBlock *blocks;    // blocks[0] is the entry
+    int size;
+    int capacity;
+    int balanced;  // every block starts and ends with an empty stack
+    int next_label;
+} IrFunction;
+
+// a pass returns the number of VM instructions it removed, code motion counts those taken out of loops, or -1 after failing
+typedef int (*IrPass)(IrFunction *function);
+
+typedef struct {
+    char *name;
+    IrPass run;
+    int level;  // lowest optimization level that runs the pass
+    int enabled;
+    int removed;     // totals over every function of the last run_ir_passes
+    double seconds;
+} IrPassEntry;
+
+int stack_pops(VmInstruction *instruction);
+int stack_pushes(VmInstruction *instruction);
+
+int add_block(IrFunction *function);
+int insert_block(IrFunction *function, int position);
+int find_block_label(IrFunction *function, char *label);
+void add_block_instruction(BasicBlock *block, VmInstruction *instruction);
+void update_cfg(IrFunction *function);
+int build_ir_function(IrFunction *function, VmFile *file, int start, int end);
+void free_ir_function(IrFunction *function);
+void lower_ir_function(IrFunction *function, VmFile *output);
+void compute_dominators(IrFunction *function);
+int dominates(IrFunction *function, int a, int b);
+int count_ir_instructions(IrFunction *function);
+void new_block_label(IrFunction *function, int block);
+void dump_ir_function(IrFunction *function, FILE *stream);
+int remove_unreachable_blocks(IrFunction *function);
+
+void add_ir_pass(char *name, IrPass run, int level);
+IrPassEntry *find_ir_pass(char *name);
+void enable_ir_passes(int level);
+int run_ir_passes(VmProgram *program, int dump);
+void print_ir_pass_report(int timing);
+
+#endif
@@ -0,0 +1,706 @@
+#include "jit.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "natives.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+#define JIT_BUFFER_SIZE (16 * 1024 * 1024)
+#define MAX_INSTRUCTION_BYTES 96
+#define ENTRY_BYTES 64
+
+// x86-64 register numbers
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSP 4
+#define RBP 5
+#define RSI 6
+#define RDI 7
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
+
+// VM state lives in callee-saved registers so native OS calls leave it alone
+#define REG_RAM RBX
+#define REG_SP R12
+#define REG_LCL R13
+#define REG_ARG R14
+#define REG_THIS R15
+#define REG_THAT RBP
+
+// condition codes
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_L 0xC
+#define CC_GE 0xD
+#define CC_G 0xF
+
+typedef struct {
+    int position;  // offset of the rel32 to patch
+    int pc;        // target pc, or -1 for the exit stub
+} JitFixup;
+
+struct Jit {
+    unsigned char *buffer;
+    int used;
+    JitEntry *entries;  // per decoded pc, NULL when compiled code can not be entered there
+    char *attempted;    // per function
+    int *offsets;       // per pc of the function being compiled, offset of its code
+    JitFixup *fixups;
+    int fixup_count;
+    JitContext context;
+};
+
+typedef struct Jit Jit;
+
+void byte(Jit *jit, int value) {
+    jit->buffer[jit->used] = (unsigned char)value;
+    jit->used += 1;
+}
+
+void dword(Jit *jit, int value) {
+    memcpy(jit->buffer + jit->used, &value, 4);
+    jit->used += 4;
+}
+
+void qword(Jit *jit, uint64_t value) {
+    memcpy(jit->buffer + jit->used, &value, 8);
+    jit->used += 8;
+}
+
+void rex(Jit *jit, int w, int reg, int index, int base) {
+    int value = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+    if (value != 0x40) {
+        byte(jit, value);
+    }
+}
+
+// ModRM (+SIB) + disp32 for [base + index * 2 + disp], index < 0 means no index
+void mem(Jit *jit, int reg, int base, int index, int disp) {
+    if (index >= 0) {
+        byte(jit, 0x80 | ((reg & 7) << 3) | 4);
+        byte(jit, 0x40 | ((index & 7) << 3) | (base & 7));
+    } else if ((base & 7) == RSP) {
+        byte(jit, 0x80 | ((reg & 7) << 3) | 4);
+        byte(jit, 0x24);
+    } else {
+        byte(jit, 0x80 | ((reg & 7) << 3) | (base & 7));
+    }
+    dword(jit, disp);
+}
+
+// movsx reg32, word [base + index * 2 + disp]
+void load16(Jit *jit, int reg, int base, int index, int disp) {
+    rex(jit, 0, reg, index < 0 ? 0 : index, base);
+    byte(jit, 0x0F);
+    byte(jit, 0xBF);
+    mem(jit, reg, base, index, disp);
+}
+
+// mov word [base + index * 2 + disp], reg16
+void store16(Jit *jit, int reg, int base, int index, int disp) {
+    byte(jit, 0x66);
+    rex(jit, 0, reg, index < 0 ? 0 : index, base);
+    byte(jit, 0x89);
+    mem(jit, reg, base, index, disp);
+}
+
+void store16_imm(Jit *jit, int base, int index, int disp, int value) {
+    byte(jit, 0x66);
+    rex(jit, 0, 0, index < 0 ? 0 : index, base);
+    byte(jit, 0xC7);
+    mem(jit, 0, base, index, disp);
+    byte(jit, value & 0xFF);
+    byte(jit, (value >> 8) & 0xFF);
+}
+
+// add / or / and / sub / cmp reg32, imm32 selected by the /digit extension
+void alu_imm(Jit *jit, int extension, int reg, int value) {
+    rex(jit, 0, 0, 0, reg);
+    byte(jit, 0x81);
+    byte(jit, 0xC0 | (extension << 3) | (reg & 7));
+    dword(jit, value);
+}
+
+// two register form, dst = dst op src
+void alu_reg(Jit *jit, int opcode, int dst, int src) {
+    rex(jit, 0, src, 0, dst);
+    byte(jit, opcode);
+    byte(jit, 0xC0 | ((src & 7) << 3) | (dst & 7));
+}
+
+void unary(Jit *jit, int extension, int reg) {
+    rex(jit, 0, 0, 0, reg);
+    byte(jit, 0xF7);
+    byte(jit, 0xC0 | (extension << 3) | (reg & 7));
+}
+
+void mov_imm32(Jit *jit, int reg, int value) {
+    rex(jit, 0, 0, 0, reg);
+    byte(jit, 0xB8 | (reg & 7));
+    dword(jit, value);
+}
+
+void mov_imm64(Jit *jit, int reg, uint64_t value) {
+    rex(jit, 1, 0, 0, reg);
+    byte(jit, 0xB8 | (reg & 7));
+    qword(jit, value);
+}
+
+void push_reg(Jit *jit, int reg) {
+    rex(jit, 0, 0, 0, reg);
+    byte(jit, 0x50 | (reg & 7));
+}
+
+void pop_reg(Jit *jit, int reg) {
+    rex(jit, 0, 0, 0, reg);
+    byte(jit, 0x58 | (reg & 7));
+}
+
+#define ADD_EXT 0
+#define OR_EXT 1
+#define AND_EXT 4
+#define SUB_EXT 5
+#define CMP_EXT 7
+
+#define MOV_RR 0x89
+#define ADD_RR 0x01
+#define SUB_RR 0x29
+#define AND_RR 0x21
+#define OR_RR 0x09
+#define CMP_RR 0x39
+#define TEST_RR 0x85
+
+void jump_to(Jit *jit, int condition, int pc) {
+    if (condition < 0) {
+        byte(jit, 0xE9);
+    } else {
+        byte(jit, 0x0F);
+        byte(jit, 0x80 | condition);
+    }
+    jit->fixups[jit->fixup_count].position = jit->used;
+    jit->fixups[jit->fixup_count].pc = pc;
+    jit->fixup_count += 1;
+    dword(jit, 0);
+}
+
+// leave compiled code, the interpreter resumes at pc
+void exit_at(Jit *jit, int condition, int pc) {
+    if (condition >= 0) {
+        // skip the exit when the condition does not hold
+        byte(jit, 0x70 | (condition ^ 1));
+        byte(jit, 10);
+    }
+    mov_imm32(jit, RAX, pc);
+    jump_to(jit, -1, -1);
+}
+
+void load_top(Jit *jit, int reg, int depth) {
+    load16(jit, reg, REG_RAM, REG_SP, -2 * depth);
+}
+
+void store_top(Jit *jit, int reg, int depth) {
+    store16(jit, reg, REG_RAM, REG_SP, -2 * depth);
+}
+
+void push_value(Jit *jit, int reg) {
+    store16(jit, reg, REG_RAM, REG_SP, 0);
+    alu_imm(jit, ADD_EXT, REG_SP, 1);
+}
+
+// ecx = (base + offset) & RAM_MASK
+void pointer_address(Jit *jit, int base, int offset) {
+    alu_reg(jit, MOV_RR, RCX, base);
+    if (offset != 0) {
+        alu_imm(jit, ADD_EXT, RCX, offset);
+    }
+    alu_imm(jit, AND_EXT, RCX, RAM_MASK);
+}
+
+void compare(Jit *jit, int condition) {
+    load_top(jit, RCX, 2);
+    load_top(jit, RAX, 1);
+    alu_reg(jit, 0x31, RDX, RDX);  // xor edx, edx
+    alu_reg(jit, CMP_RR, RCX, RAX);
+    byte(jit, 0x0F);
+    byte(jit, 0x90 | condition);
+    byte(jit, 0xC0 | RDX);
+    unary(jit, 3, RDX);  // neg edx
+    store_top(jit, RDX, 2);
+    alu_imm(jit, SUB_EXT, REG_SP, 1);
+}
+
+void binary(Jit *jit, int opcode) {
+    load_top(jit, RCX, 2);
+    load_top(jit, RAX, 1);
+    alu_reg(jit, opcode, RCX, RAX);
+    store_top(jit, RCX, 2);
+    alu_imm(jit, SUB_EXT, REG_SP, 1);
+}
+
+void count_steps(Jit *jit, int count) {
+    mov_imm64(jit, RAX, (uint64_t)(uintptr_t)&jit->context.steps);
+    byte(jit, 0x48);
+    byte(jit, 0x81);
+    mem(jit, 0, RAX, -1, 0);
+    dword(jit, count);
+}
+
+// exits to the interpreter at target once the step budget is used up
+void check_budget(Jit *jit, int pc) {
+    mov_imm64(jit, RAX, (uint64_t)(uintptr_t)&jit->context.steps);
+    byte(jit, 0x48);
+    byte(jit, 0x8B);
+    mem(jit, RAX, RAX, -1, 0);
+    mov_imm64(jit, RDX, (uint64_t)(uintptr_t)&jit->context.budget);
+    byte(jit, 0x48);
+    byte(jit, 0x3B);
+    mem(jit, RAX, RDX, -1, 0);
+    exit_at(jit, CC_GE, pc);
+}
+
+// VM instructions a decoded instruction stands for, 0 when the interpreter runs it
+int instruction_weight(int op) {
+    switch (op) {
+        case OP_CALL:
+        case OP_ENTER:
+        case OP_RETURN:
+        case OP_HALT:
+            return 0;
+        case OP_ADD_CONST:
+        case OP_IF_NOT_GOTO:
+        case OP_IF_EQ_GOTO:
+        case OP_IF_GT_GOTO:
+        case OP_IF_LT_GOTO:
+            return 2;
+        case OP_ARRAY_LOAD:
+            return 3;
+        case OP_LOAD_OFFSET:
+        case OP_ARRAY_STORE:
+        case OP_INC_LOCAL:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+int is_jump(int op) {
+    return op == OP_GOTO || op == OP_IF_GOTO || op == OP_IF_NOT_GOTO ||
+           op == OP_IF_EQ_GOTO || op == OP_IF_GT_GOTO || op == OP_IF_LT_GOTO;
+}
+
+int ends_block(int op) {
+    return is_jump(op) || op == OP_CALL || op == OP_RETURN || op == OP_HALT;
+}
+
+void emit_instruction_code(Interpreter *vm, Jit *jit, int pc) {
+    DecodedInstruction *instruction = &vm->code[pc];
+    int arg = instruction->arg;
+
+    switch (instruction->op) {
+        case OP_ADD:
+            binary(jit, ADD_RR);
+            break;
+        case OP_SUB:
+            binary(jit, SUB_RR);
+            break;
+        case OP_AND:
+            binary(jit, AND_RR);
+            break;
+        case OP_OR:
+            binary(jit, OR_RR);
+            break;
+        case OP_NEG:
+        case OP_NOT:
+            load_top(jit, RAX, 1);
+            unary(jit, instruction->op == OP_NEG ? 3 : 2, RAX);
+            store_top(jit, RAX, 1);
+            break;
+        case OP_EQ:
+            compare(jit, CC_E);
+            break;
+        case OP_GT:
+            compare(jit, CC_G);
+            break;
+        case OP_LT:
+            compare(jit, CC_L);
+            break;
+        case OP_PUSH_CONST:
+            store16_imm(jit, REG_RAM, REG_SP, 0, arg);
+            alu_imm(jit, ADD_EXT, REG_SP, 1);
+            break;
+        case OP_PUSH_LOCAL:
+        case OP_PUSH_ARG:
+            load16(jit, RAX, REG_RAM, instruction->op == OP_PUSH_LOCAL ? REG_LCL : REG_ARG, 2 * arg);
+            push_value(jit, RAX);
+            break;
+        case OP_PUSH_THIS:
+        case OP_PUSH_THAT:
+            pointer_address(jit, instruction->op == OP_PUSH_THIS ? REG_THIS : REG_THAT, arg);
+            load16(jit, RAX, REG_RAM, RCX, 0);
+            push_value(jit, RAX);
+            break;
+        case OP_PUSH_POINTER0:
+            push_value(jit, REG_THIS);
+            break;
+        case OP_PUSH_POINTER1:
+            push_value(jit, REG_THAT);
+            break;
+        case OP_PUSH_RAM:
+            load16(jit, RAX, REG_RAM, -1, 2 * arg);
+            push_value(jit, RAX);
+            break;
+        case OP_POP_LOCAL:
+        case OP_POP_ARG:
+            load_top(jit, RAX, 1);
+            store16(jit, RAX, REG_RAM, instruction->op == OP_POP_LOCAL ? REG_LCL : REG_ARG, 2 * arg);
+            alu_imm(jit, SUB_EXT, REG_SP, 1);
+            break;
+        case OP_POP_THIS:
+        case OP_POP_THAT:
+            pointer_address(jit, instruction->op == OP_POP_THIS ? REG_THIS : REG_THAT, arg);
+            load_top(jit, RAX, 1);
+            store16(jit, RAX, REG_RAM, RCX, 0);
+            alu_imm(jit, SUB_EXT, REG_SP, 1);
+            break;
+        case OP_POP_POINTER0:
+        case OP_POP_POINTER1:
+            load_top(jit, instruction->op == OP_POP_POINTER0 ? REG_THIS : REG_THAT, 1);
+            alu_imm(jit, SUB_EXT, REG_SP, 1);
+            break;
+        case OP_POP_RAM:
+            load_top(jit, RAX, 1);
+            store16(jit, RAX, REG_RAM, -1, 2 * arg);
+            alu_imm(jit, SUB_EXT, REG_SP, 1);
+            break;
+        case OP_ADD_CONST:
+            load_top(jit, RAX, 1);
+            alu_imm(jit, ADD_EXT, RAX, arg);
+            store_top(jit, RAX, 1);
+            break;
+        case OP_ARRAY_LOAD:
+            load_top(jit, RCX, 2);
+            load_top(jit, RAX, 1);
+            alu_reg(jit, ADD_RR, RCX, RAX);
+            alu_reg(jit, MOV_RR, REG_THAT, RCX);
+            alu_imm(jit, AND_EXT, RCX, RAM_MASK);
+            load16(jit, RAX, REG_RAM, RCX, 0);
+            store_top(jit, RAX, 2);
+            alu_imm(jit, SUB_EXT, REG_SP, 1);
+            break;
+        case OP_LOAD_OFFSET:
+            load_top(jit, RCX, 1);
+            alu_imm(jit, ADD_EXT, RCX, arg);
+            alu_reg(jit, MOV_RR, REG_THAT, RCX);
+            alu_imm(jit, AND_EXT, RCX, RAM_MASK);
+            load16(jit, RAX, REG_RAM, RCX, 0);
+            store_top(jit, RAX, 1);
+            break;
+        case OP_ARRAY_STORE:
+            load_top(jit, RCX, 2);
+            load_top(jit, RAX, 1);
+            alu_reg(jit, MOV_RR, REG_THAT, RCX);
+            store16(jit, RAX, REG_RAM, -1, 2 * 5);
+            alu_imm(jit, AND_EXT, RCX, RAM_MASK);
+            store16(jit, RAX, REG_RAM, RCX, 0);
+            alu_imm(jit, SUB_EXT, REG_SP, 2);
+            break;
+        case OP_INC_LOCAL:
+            load16(jit, RAX, REG_RAM, REG_LCL, 2 * arg);
+            alu_imm(jit, ADD_EXT, RAX, instruction->arg2);
+            store16(jit, RAX, REG_RAM, REG_LCL, 2 * arg);
+            break;
+        case OP_GOTO:
+            if (arg <= pc) {
+                check_budget(jit, arg);
+            }
+            jump_to(jit, -1, arg);
+            break;
+        case OP_IF_GOTO:
+        case OP_IF_NOT_GOTO:
+            alu_imm(jit, SUB_EXT, REG_SP, 1);
+            load16(jit, RAX, REG_RAM, REG_SP, 0);
+            if (instruction->op == OP_IF_GOTO) {
+                alu_reg(jit, TEST_RR, RAX, RAX);
+            } else {
+                alu_imm(jit, CMP_EXT, RAX, -1);
+            }
+            if (arg <= pc) {
+                // backward branches fall out of the loop here, budget checked on the taken path
+                byte(jit, 0x70 | CC_E);
+                int skip = jit->used;
+                byte(jit, 0);
+                check_budget(jit, arg);
+                jump_to(jit, -1, arg);
+                jit->buffer[skip] = (unsigned char)(jit->used - skip - 1);
+            } else {
+                jump_to(jit, CC_NE, arg);
+            }
+            break;
+        case OP_IF_EQ_GOTO:
+        case OP_IF_GT_GOTO:
+        case OP_IF_LT_GOTO: {
+            int condition = instruction->op == OP_IF_EQ_GOTO ? CC_E : (instruction->op == OP_IF_GT_GOTO ? CC_G : CC_L);
+            alu_imm(jit, SUB_EXT, REG_SP, 2);
+            load16(jit, RCX, REG_RAM, REG_SP, 0);
+            load16(jit, RAX, REG_RAM, REG_SP, 2);
+            alu_reg(jit, CMP_RR, RCX, RAX);
+            if (arg <= pc) {
+                byte(jit, 0x70 | (condition ^ 1));
+                int skip = jit->used;
+                byte(jit, 0);
+                check_budget(jit, arg);
+                jump_to(jit, -1, arg);
+                jit->buffer[skip] = (unsigned char)(jit->used - skip - 1);
+            } else {
+                jump_to(jit, condition, arg);
+            }
+            break;
+        }
+        case OP_NATIVE: {
+            // native(vm, ram + sp) with the arguments in place, the result replaces them
+            alu_imm(jit, SUB_EXT, REG_SP, instruction->arg2);
+            mov_imm64(jit, RDI, (uint64_t)(uintptr_t)vm);
+            byte(jit, 0x4A);  // lea rsi, [rbx + r12 * 2]
+            byte(jit, 0x8D);
+            mem(jit, RSI, REG_RAM, REG_SP, 0);
+            mov_imm64(jit, RAX, (uint64_t)(uintptr_t)get_native(arg)->function);
+            byte(jit, 0xFF);  // call rax
+            byte(jit, 0xD0);
+            push_value(jit, RAX);
+            mov_imm64(jit, RCX, (uint64_t)(uintptr_t)&vm->halted);
+            byte(jit, 0x81);  // cmp dword [rcx], 0
+            mem(jit, CMP_EXT, RCX, -1, 0);
+            dword(jit, 0);
+            exit_at(jit, CC_NE, pc + 1);
+            break;
+        }
+        default:
+            // calls, returns and anything else go back to the interpreter
+            exit_at(jit, -1, pc);
+            break;
+    }
+}
+
+// prologue of one entry point: save callee-saved registers, load the VM registers, jump into the body
+void emit_entry(Jit *jit, int16_t *ram, int body_offset) {
+    push_reg(jit, RBX);
+    push_reg(jit, RBP);
+    push_reg(jit, R12);
+    push_reg(jit, R13);
+    push_reg(jit, R14);
+    push_reg(jit, R15);
+    push_reg(jit, RDI);  // the context pointer also realigns the stack to 16 bytes
+    mov_imm64(jit, REG_RAM, (uint64_t)(uintptr_t)ram);
+
+    int registers[] = {REG_SP, REG_LCL, REG_ARG, REG_THIS, REG_THAT};
+    for (int i = 0; i < 5; i++) {
+        rex(jit, 0, registers[i], 0, RDI);
+        byte(jit, 0x8B);
+        mem(jit, registers[i], RDI, -1, 4 * i);
+    }
+
+    byte(jit, 0xE9);
+    dword(jit, body_offset - (jit->used + 4));
+}
+
+void emit_exit_stub(Jit *jit) {
+    byte(jit, 0x48);  // mov rdi, [rsp]
+    byte(jit, 0x8B);
+    mem(jit, RDI, RSP, -1, 0);
+
+    int registers[] = {REG_SP, REG_LCL, REG_ARG, REG_THIS, REG_THAT};
+    for (int i = 0; i < 5; i++) {
+        rex(jit, 0, registers[i], 0, RDI);
+        byte(jit, 0x89);
+        mem(jit, registers[i], RDI, -1, 4 * i);
+    }
+
+    pop_reg(jit, RDI);
+    pop_reg(jit, R15);
+    pop_reg(jit, R14);
+    pop_reg(jit, R13);
+    pop_reg(jit, R12);
+    pop_reg(jit, RBP);
+    pop_reg(jit, RBX);
+    byte(jit, 0xC3);
+}
+
+int compile_function(Interpreter *vm, Jit *jit, int function) {
+    int start = vm->functions[function].entry + 1;
+    int end = start;
+    while (end < vm->size && vm->code[end].op != OP_ENTER && vm->code[end].op != OP_HALT) {
+        end += 1;
+    }
+
+    int entry_count = 1;
+    for (int pc = start; pc < end; pc++) {
+        if (vm->code[pc].op == OP_CALL) {
+            entry_count += 1;
+        }
+        if (is_jump(vm->code[pc].op) && (vm->code[pc].arg < start || vm->code[pc].arg >= end)) {
+            return FALSE;
+        }
+    }
+    if (jit->used + (end - start) * MAX_INSTRUCTION_BYTES + entry_count * ENTRY_BYTES + ENTRY_BYTES > JIT_BUFFER_SIZE) {
+        return FALSE;
+    }
+
+    // basic blocks start at the entry, at jump targets and after anything that leaves straight-line code
+    char *block_start = calloc(end - start + 1, sizeof(char));
+    block_start[0] = TRUE;
+    for (int pc = start; pc < end; pc++) {
+        if (is_jump(vm->code[pc].op)) {
+            block_start[vm->code[pc].arg - start] = TRUE;
+        }
+        if (ends_block(vm->code[pc].op)) {
+            block_start[pc + 1 - start] = TRUE;
+        }
+    }
+
+    mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE);
+    jit->fixup_count = 0;
+    int first = jit->used;
+
+    for (int pc = start; pc < end; pc++) {
+        jit->offsets[pc] = jit->used;
+        if (block_start[pc - start] == TRUE) {
+            int weight = 0;
+            for (int k = pc; k < end && (k == pc || block_start[k - start] == FALSE); k++) {
+                weight += instruction_weight(vm->code[k].op);
+            }
+            if (weight > 0) {
+                count_steps(jit, weight);
+            }
+        }
+        emit_instruction_code(vm, jit, pc);
+    }
+    // falling off the end of a function goes back to the interpreter
+    exit_at(jit, -1, end);
+
+    int exit_stub = jit->used;
+    emit_exit_stub(jit);
+
+    for (int i = 0; i < jit->fixup_count; i++) {
+        int target = jit->fixups[i].pc < 0 ? exit_stub : jit->offsets[jit->fixups[i].pc];
+        int relative = target - (jit->fixups[i].position + 4);
+        memcpy(jit->buffer + jit->fixups[i].position, &relative, 4);
+    }
+
+    for (int pc = start; pc < end; pc++) {
+        if (pc == start || vm->code[pc - 1].op == OP_CALL) {
+            int entry = jit->used;
+            emit_entry(jit, vm->ram, jit->offsets[pc]);
+            jit->entries[pc] = (JitEntry)(void *)(jit->buffer + entry);
+        }
+    }
+
+    mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC);
+    __builtin___clear_cache((char *)jit->buffer + first, (char *)jit->buffer + jit->used);
+    free(block_start);
+    return TRUE;
+}
+
+int enable_jit(Interpreter *vm) {
+    // the tables below are sized for the loaded program
+    if (vm->size == 0 || vm->function_count == 0 || vm->jit != NULL) {
+        return FALSE;
+    }
+    // the counting stub of the pair statistics and the profile must see every instruction
+    if (vm->pair_counts != NULL || vm->profile != NULL) {
+        return FALSE;
+    }
+
+    Jit *jit = (Jit *)malloc(sizeof(Jit));
+    jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->buffer == MAP_FAILED) {
+        free(jit);
+        return FALSE;
+    }
+    jit->used = 0;
+    jit->entries = (JitEntry *)calloc(vm->size, sizeof(JitEntry));
+    jit->attempted = (char *)calloc(vm->function_count, sizeof(char));
+    jit->offsets = (int *)calloc(vm->size, sizeof(int));
+    jit->fixups = (JitFixup *)malloc(sizeof(JitFixup) * (vm->size * 2 + 16));
+    jit->fixup_count = 0;
+    vm->jit = jit;
+    return TRUE;
+}
+
+void stop_jit(Interpreter *vm) {
+    Jit *jit = vm->jit;
+    if (jit == NULL) {
+        return;
+    }
+    munmap(jit->buffer, JIT_BUFFER_SIZE);
+    free(jit->entries);
+    free(jit->attempted);
+    free(jit->offsets);
+    free(jit->fixups);
+    free(jit);
+    vm->jit = NULL;
+}
+
+// native entry of a function right after its locals are set up, compiled on the first call
+JitEntry jit_function_entry(Interpreter *vm, int function) {
+    Jit *jit = vm->jit;
+    int pc = vm->functions[function].entry + 1;
+    if (jit->attempted[function] == FALSE) {
+        jit->attempted[function] = TRUE;
+        if (compile_function(vm, jit, function) == FALSE) {
+            return NULL;
+        }
+    }
+    return jit->entries[pc];
+}
+
+JitEntry jit_entry_at(Interpreter *vm, int pc) {
+    return vm->jit->entries[pc];
+}
+
+JitContext *get_jit_context(Interpreter *vm) {
+    return &vm->jit->context;
+}
+
+#else
+
+// other targets keep running on the interpreter
+int enable_jit(Interpreter *vm) {
+    (void)vm;
+    return FALSE;
+}
+
+void stop_jit(Interpreter *vm) {
+    (void)vm;
+}
+
+JitEntry jit_function_entry(Interpreter *vm, int function) {
+    (void)vm;
+    (void)function;
+    return NULL;
+}
+
+JitEntry jit_entry_at(Interpreter *vm, int pc) {
+    (void)vm;
+    (void)pc;
+    return NULL;
+}
+
+JitContext *get_jit_context(Interpreter *vm) {
+    (void)vm;
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "interpreter.h"
+
+// VM registers handed between the interpreter and compiled code
+typedef struct {
+    int sp;
+    int lcl;
+    int arg;
+    int this;
+    int that;
+    long long steps;   // instructions executed by compiled code since entry
+    long long budget;  // compiled code exits at a backward jump once steps reach it
+} JitContext;
+
+// native code for one entry point of a function, returns the pc the interpreter resumes at
+typedef int (*JitEntry)(JitContext *context);
+
+// call after load_interpreter(), FALSE when no program is loaded yet, the JIT is already on, or statistics
+// are collected; stop_jit() before loading another program
+int enable_jit(Interpreter *vm);
+void stop_jit(Interpreter *vm);
+JitEntry jit_function_entry(Interpreter *vm, int function);
+JitEntry jit_entry_at(Interpreter *vm, int pc);
+JitContext *get_jit_context(Interpreter *vm);
+
+#endif
@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#include "interface.h"
 
 #define ERROR 0
 #define NO_ERROR 1
@@ -22,6 +25,21 @@ int *total_tokens;
 int *line_of_token;
 int *parsing_idx;
 
+// tokens of every file lexed while caching is on, by path, a resident compiler keeps them between builds
+typedef struct {
+    char path[256];
+    long long modified;  // modification time in nanoseconds
+    long size;
+    unsigned long long hash;
+    Token *tokens;
+    int count;
+} CachedTokens;
+
+int token_caching = FALSE;
+CachedTokens *token_cache = NULL;
+int token_cache_size = 0;
+int token_cache_capacity = 0;
+
 char *reserved_words[] = {
     "class", "constructor", "method", "function", "int", "boolean", "char",
     "void", "var", "static", "field", "let", "do", "if",
@@ -35,29 +53,32 @@ int is_reserved_word(char *word) {
     return FALSE;
 }
 
-Token *init_token() {
-    Token *token = (Token *)malloc(sizeof(Token));
-    token->tp = ERR;
-    token->ec = IllSym;
-    token->ln = *line_of_token;
-    strncpy(token->lx, "Error: illegal symbol in source file", LEXEME_LEN);
-    strncpy(token->fl, input_file_name, FILE_NAME_LEN);
+Token init_token() {
+    Token token;
+    token.tp = ERR;
+    token.ec = IllSym;
+    token.ln = *line_of_token;
+    strncpy(token.lx, "Error: illegal symbol in source file", LEXEME_LEN);
+    strncpy(token.fl, input_file_name, FILE_NAME_LEN);
     return token;
 }
 
 void parse_tokens(char *buffer) {
     int i = 0;
     int token_idx = 0;
-    Token *token = init_token();
-    tokens = (Token *)malloc((token_idx + 1) * sizeof(Token));
-    tokens[token_idx] = *token;
+    // grown by doubling, a library file runs to thousands of tokens
+    int token_capacity = 256;
+    tokens = (Token *)malloc(token_capacity * sizeof(Token));
+    tokens[token_idx] = init_token();
     int flag = FALSE;
 
     while (i < *input_file_size + 1) {
         if (flag == TRUE) {
-            tokens = (Token *)realloc(tokens, (token_idx + 1) * sizeof(Token));
-            Token *new_token = init_token();
-            tokens[token_idx] = *new_token;
+            if (token_idx == token_capacity) {
+                token_capacity *= 2;
+                tokens = (Token *)realloc(tokens, token_capacity * sizeof(Token));
+            }
+            tokens[token_idx] = init_token();
             flag = FALSE;
         }
 
@@ -248,6 +269,71 @@ void parse_tokens(char *buffer) {
     *total_tokens = token_idx;
 }
 
+CachedTokens *find_cached_tokens(char *file_name) {
+    for (int i = 0; i < token_cache_size; i++) {
+        if (strcmp(token_cache[i].path, file_name) == 0) {
+            return &token_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// a file keeps its tokens while its modification time and size, or else its contents, are unchanged
+int reuse_cached_tokens(char *file_name) {
+    struct stat info;
+    if (strlen(file_name) >= sizeof(token_cache[0].path) || stat(file_name, &info) != 0) {
+        return FALSE;
+    }
+    long long modified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    CachedTokens *entry = find_cached_tokens(file_name);
+    int unchanged = entry != NULL && entry->modified == modified && entry->size == *input_file_size;
+    if (unchanged == FALSE) {
+        unsigned long long hash = hash_bytes(14695981039346656037ull, buffer, *input_file_size);
+        unchanged = entry != NULL && entry->hash == hash;
+        if (entry == NULL) {
+            if (token_cache_size == token_cache_capacity) {
+                token_cache_capacity = token_cache_capacity == 0 ? 64 : token_cache_capacity * 2;
+                token_cache = (CachedTokens *)realloc(token_cache, sizeof(CachedTokens) * token_cache_capacity);
+            }
+            entry = &token_cache[token_cache_size];
+            token_cache_size += 1;
+            strcpy(entry->path, file_name);
+            entry->tokens = NULL;
+        }
+        entry->modified = modified;
+        entry->size = *input_file_size;
+        entry->hash = hash;
+    }
+
+    if (unchanged == TRUE) {
+        tokens = (Token *)malloc(sizeof(Token) * (entry->count + 1));
+        memcpy(tokens, entry->tokens, sizeof(Token) * entry->count);
+        *total_tokens = entry->count;
+    } else {
+        // lexed as usual, then kept for the next time
+        parse_tokens(buffer);
+        free(entry->tokens);
+        entry->tokens = (Token *)malloc(sizeof(Token) * (*total_tokens + 1));
+        memcpy(entry->tokens, tokens, sizeof(Token) * *total_tokens);
+        entry->count = *total_tokens;
+    }
+    return TRUE;
+}
+
+// keep the tokens of every file lexed from now on, turning caching off forgets them
+void SetTokenCaching(int caching) {
+    token_caching = caching;
+    if (caching == FALSE) {
+        for (int i = 0; i < token_cache_size; i++) {
+            free(token_cache[i].tokens);
+        }
+        free(token_cache);
+        token_cache = NULL;
+        token_cache_size = 0;
+        token_cache_capacity = 0;
+    }
+}
+
 // init lexer
 int InitLexer(char *file_name) {
     input_file = fopen(file_name, "r");
@@ -283,7 +369,9 @@ int InitLexer(char *file_name) {
     total_tokens = (int *)malloc(sizeof(int));
     *total_tokens = 1;
 
-    parse_tokens(buffer);
+    if (token_caching == FALSE || reuse_cached_tokens(file_name) == FALSE) {
+        parse_tokens(buffer);
+    }
 
     return NO_ERROR;
 }
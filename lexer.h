@@ -35,4 +35,5 @@ int InitLexer(char* file);
 Token GetNextToken();
 Token PeekNextToken();
 int StopLexer();
+void SetTokenCaching(int caching);  // keep every file's tokens until its contents change
 #endif
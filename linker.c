@@ -0,0 +1,729 @@
+#include "linker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "profile.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// one function of the program, instructions [start, end) of its file
+typedef struct {
+    VmFile *file;
+    int start;
+    int end;
+    int reachable;
+} LinkedFunction;
+
+LinkedFunction *linked_functions = NULL;
+int linked_function_count = 0;
+
+void collect_linked_functions(VmProgram *program) {
+    int count = 0;
+    for (int i = 0; i < program->size; i++) {
+        for (int j = 0; j < program->files[i].size; j++) {
+            if (program->files[i].code[j].cmd == FUNCTION_CM) {
+                count += 1;
+            }
+        }
+    }
+
+    free(linked_functions);
+    linked_functions = (LinkedFunction *)malloc(sizeof(LinkedFunction) * (count + 1));
+    linked_function_count = 0;
+    for (int i = 0; i < program->size; i++) {
+        VmFile *file = &program->files[i];
+        for (int j = 0; j < file->size; j++) {
+            if (file->code[j].cmd != FUNCTION_CM) {
+                continue;
+            }
+            if (linked_function_count > 0 && linked_functions[linked_function_count - 1].file == file) {
+                linked_functions[linked_function_count - 1].end = j;
+            }
+            linked_functions[linked_function_count].file = file;
+            linked_functions[linked_function_count].start = j;
+            linked_functions[linked_function_count].end = file->size;
+            linked_functions[linked_function_count].reachable = FALSE;
+            linked_function_count += 1;
+        }
+    }
+}
+
+int find_linked_function(char *name) {
+    for (int i = 0; i < linked_function_count; i++) {
+        LinkedFunction *function = &linked_functions[i];
+        if (strcmp(function->file->code[function->start].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// what inlining a callee needs to know about its body
+typedef struct {
+    int temp_base;     // first temp slot the body leaves free
+    int uses_statics;  // statics belong to the callee's class
+    int sets_this;
+} InlineInfo;
+
+// small straight-line leaves only: no calls, no jumps and a single return at the end
+int is_inline_candidate(LinkedFunction *callee, int budget, InlineInfo *info) {
+    int size = callee->end - callee->start - 1;
+    if (size < 1 || size > budget) {
+        return FALSE;
+    }
+
+    info->temp_base = 1;  // temp 0 is the code generator's scratch slot
+    info->uses_statics = FALSE;
+    info->sets_this = FALSE;
+    int depth = 0;
+    for (int j = callee->start + 1; j < callee->end; j++) {
+        VmInstruction *instruction = &callee->file->code[j];
+        switch (instruction->cmd) {
+            case CALL_CM:
+            case LABEL_CM:
+            case GOTO_CM:
+            case IF_GOTO_CM:
+            case FUNCTION_CM:
+                return FALSE;
+            case RETURN_CM:
+                // the returned value must be the only thing left on the callee's stack
+                if (j != callee->end - 1 || depth != 1) {
+                    return FALSE;
+                }
+                break;
+            case PUSH_CM:
+            case POP_CM:
+                depth += instruction->cmd == PUSH_CM ? 1 : -1;
+                if (instruction->seg == TEMP_SEG && instruction->idx + 1 > info->temp_base) {
+                    info->temp_base = instruction->idx + 1;
+                }
+                if (instruction->seg == STATIC_SEG) {
+                    info->uses_statics = TRUE;
+                }
+                if (instruction->cmd == POP_CM && instruction->seg == POINTER_SEG && instruction->idx == 0) {
+                    info->sets_this = TRUE;
+                }
+                break;
+            case NEG_CM:
+            case NOT_CM:
+                break;
+            default:
+                depth -= 1;
+                break;
+        }
+        if (depth < 0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+int uses_this(LinkedFunction *function) {
+    for (int j = function->start + 1; j < function->end; j++) {
+        VmInstruction *instruction = &function->file->code[j];
+        if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) &&
+            (instruction->seg == THIS_SEG || (instruction->seg == POINTER_SEG && instruction->idx == 0))) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+VmInstruction temp_access(VmCommand cmd, int idx) {
+    VmInstruction instruction;
+    instruction.cmd = cmd;
+    instruction.seg = TEMP_SEG;
+    instruction.idx = idx;
+    instruction.name[0] = '\0';
+    return instruction;
+}
+
+VmInstruction pointer_access(VmCommand cmd, int idx) {
+    VmInstruction instruction = temp_access(cmd, idx);
+    instruction.seg = POINTER_SEG;
+    return instruction;
+}
+
+// the callee body with arguments and locals moved to temp slots, returns FALSE when they do not fit
+int expand_inline_call(VmFile *output, LinkedFunction *caller, LinkedFunction *callee, InlineInfo *info, int args) {
+    VmInstruction *function = &callee->file->code[callee->start];
+    int save_this = info->sets_this == TRUE && uses_this(caller) == TRUE;
+    int save_slot = info->temp_base + args + function->idx;
+    if (save_slot + save_this > 8) {
+        return FALSE;
+    }
+    for (int j = callee->start + 1; j < callee->end; j++) {
+        VmInstruction *instruction = &callee->file->code[j];
+        if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == ARGUMENT_SEG && instruction->idx >= args) {
+            return FALSE;
+        }
+    }
+
+    // pointer 1 needs no saving, generated code sets it right before every that access
+    if (save_this == TRUE) {
+        append_instruction(output, pointer_access(PUSH_CM, 0));
+        append_instruction(output, temp_access(POP_CM, save_slot));
+    }
+    for (int i = args - 1; i >= 0; i--) {
+        append_instruction(output, temp_access(POP_CM, info->temp_base + i));
+    }
+
+    // locals start out as zero unless the body assigns them before reading
+    for (int i = 0; i < function->idx; i++) {
+        for (int j = callee->start + 1; j < callee->end; j++) {
+            VmInstruction *instruction = &callee->file->code[j];
+            if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == LOCAL_SEG && instruction->idx == i) {
+                if (instruction->cmd == PUSH_CM) {
+                    VmInstruction zero = temp_access(PUSH_CM, 0);
+                    zero.seg = CONST_SEG;
+                    append_instruction(output, zero);
+                    append_instruction(output, temp_access(POP_CM, info->temp_base + args + i));
+                }
+                break;
+            }
+        }
+    }
+
+    for (int j = callee->start + 1; j < callee->end - 1; j++) {
+        VmInstruction instruction = callee->file->code[j];
+        if ((instruction.cmd == PUSH_CM || instruction.cmd == POP_CM) && instruction.seg == ARGUMENT_SEG) {
+            instruction = temp_access(instruction.cmd, info->temp_base + instruction.idx);
+        } else if ((instruction.cmd == PUSH_CM || instruction.cmd == POP_CM) && instruction.seg == LOCAL_SEG) {
+            instruction = temp_access(instruction.cmd, info->temp_base + args + instruction.idx);
+        }
+        append_instruction(output, instruction);
+    }
+
+    if (save_this == TRUE) {
+        append_instruction(output, temp_access(PUSH_CM, save_slot));
+        append_instruction(output, pointer_access(POP_CM, 0));
+    }
+    return TRUE;
+}
+
+// hot callees get a larger budget, callees the profile saw but never called stay out of line
+int profiled_inline_budget(char *name, int budget) {
+    if (has_profile() == FALSE) {
+        return budget;
+    }
+    long long count = profile_function_count(name);
+    if (count == 0) {
+        return 0;
+    }
+    if (count > 0 && count * 100 >= profile_total_calls()) {
+        return budget * 3;
+    }
+    return budget;
+}
+
+// one round of inlining over every call site, returns the number of sites expanded
+int inline_round(VmProgram *program, int budget) {
+    collect_linked_functions(program);
+
+    int inlined = 0;
+    for (int i = 0; i < program->size; i++) {
+        VmFile *file = &program->files[i];
+        VmFile output = *file;
+        output.size = 0;
+        output.capacity = file->size + 16;
+        output.code = (VmInstruction *)malloc(sizeof(VmInstruction) * output.capacity);
+
+        LinkedFunction *caller = NULL;
+        for (int j = 0; j < file->size; j++) {
+            VmInstruction *instruction = &file->code[j];
+            if (instruction->cmd == FUNCTION_CM) {
+                caller = &linked_functions[find_linked_function(instruction->name)];
+            }
+
+            if (instruction->cmd == CALL_CM && caller != NULL) {
+                int callee_index = find_linked_function(instruction->name);
+                LinkedFunction *callee = callee_index >= 0 ? &linked_functions[callee_index] : NULL;
+                InlineInfo info;
+                if (callee != NULL && callee != caller &&
+                    is_inline_candidate(callee, profiled_inline_budget(instruction->name, budget), &info) == TRUE &&
+                    (info.uses_statics == FALSE || callee->file == file)) {
+                    int mark = output.size;
+                    if (expand_inline_call(&output, caller, callee, &info, instruction->idx) == TRUE) {
+                        if (get_compiler_options()->report == TRUE) {
+                            printf("inlining: %s into %s\n", instruction->name, file->code[caller->start].name);
+                        }
+                        inlined += 1;
+                        continue;
+                    }
+                    output.size = mark;
+                }
+            }
+            append_instruction(&output, *instruction);
+        }
+
+        free(file->code);
+        file->code = output.code;
+        file->size = output.size;
+        file->capacity = output.capacity;
+    }
+
+    free(linked_functions);
+    linked_functions = NULL;
+    linked_function_count = 0;
+    return inlined;
+}
+
+int inline_functions(VmProgram *program, int budget) {
+    int inlined = 0;
+
+    // callers that became leaves can be inlined in the next round
+    for (int round = 0; round < 4; round++) {
+        int count = inline_round(program, budget);
+        if (count == 0) {
+            break;
+        }
+        inlined += count;
+    }
+
+    if (inlined > 0) {
+        if (get_compiler_options()->report == TRUE) {
+            printf("inlining: %d call sites inlined\n", inlined);
+        }
+    }
+    return inlined;
+}
+
+// drop every function not marked reachable, compacting each file in place
+void compact_linked_functions(VmProgram *program) {
+    // functions appear in file order
+    int next = 0;
+    for (int i = 0; i < program->size; i++) {
+        VmFile *file = &program->files[i];
+        int size = 0;
+        for (int j = 0; j < file->size; j++) {
+            while (next < linked_function_count && (linked_functions[next].file < file || (linked_functions[next].file == file && linked_functions[next].end <= j))) {
+                next += 1;
+            }
+            int inside = next < linked_function_count && linked_functions[next].file == file && linked_functions[next].start <= j;
+            if (inside == TRUE && linked_functions[next].reachable == FALSE) {
+                continue;
+            }
+            file->code[size] = file->code[j];
+            size += 1;
+        }
+        file->size = size;
+    }
+}
+
+// classes of the Jack OS, a program may bring its own copy of some of them
+char *os_classes[] = {"Math", "Memory", "Screen", "Output", "Keyboard", "String", "Array", "Sys"};
+
+// functions called by name from outside the program: the entry points, and while the built-in Sys.init starts
+// the program, every function of an OS class the program replaces, its init is called by Sys.init and the
+// other functions by the built-in classes
+int is_external_function(char *name, int has_sys_init) {
+    if (strcmp(name, "Sys.init") == 0 || strcmp(name, "Main.main") == 0) {
+        return TRUE;
+    }
+    if (has_sys_init == TRUE) {
+        return FALSE;
+    }
+    for (int i = 0; i < (int)(sizeof(os_classes) / sizeof(os_classes[0])); i++) {
+        int length = strlen(os_classes[i]);
+        if (strncmp(name, os_classes[i], length) == 0 && name[length] == '.') {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int shake_tree(VmProgram *program) {
+    collect_linked_functions(program);
+
+    // a program without an entry point is a library, nothing can be proven dead
+    int has_sys_init = find_linked_function("Sys.init") >= 0;
+    if (has_sys_init == FALSE && find_linked_function("Main.main") < 0) {
+        free(linked_functions);
+        linked_functions = NULL;
+        linked_function_count = 0;
+        return 0;
+    }
+
+    int *worklist = (int *)malloc(sizeof(int) * (linked_function_count + 1));
+    int worklist_size = 0;
+    for (int i = 0; i < linked_function_count; i++) {
+        LinkedFunction *function = &linked_functions[i];
+        if (is_external_function(function->file->code[function->start].name, has_sys_init) == TRUE) {
+            function->reachable = TRUE;
+            worklist[worklist_size] = i;
+            worklist_size += 1;
+        }
+    }
+
+    // calls to functions outside the program go to the OS and are not followed
+    while (worklist_size > 0) {
+        worklist_size -= 1;
+        LinkedFunction *function = &linked_functions[worklist[worklist_size]];
+        for (int j = function->start + 1; j < function->end; j++) {
+            if (function->file->code[j].cmd != CALL_CM) {
+                continue;
+            }
+            int callee = find_linked_function(function->file->code[j].name);
+            if (callee >= 0 && linked_functions[callee].reachable == FALSE) {
+                linked_functions[callee].reachable = TRUE;
+                worklist[worklist_size] = callee;
+                worklist_size += 1;
+            }
+        }
+    }
+    free(worklist);
+
+    int removed = 0;
+    int removed_instructions = 0;
+    for (int i = 0; i < linked_function_count; i++) {
+        LinkedFunction *function = &linked_functions[i];
+        if (function->reachable == FALSE) {
+            if (get_compiler_options()->report == TRUE) {
+                printf("tree shaking: removed %s (%d instructions)\n", function->file->code[function->start].name, function->end - function->start);
+            }
+            removed += 1;
+            removed_instructions += function->end - function->start;
+        }
+    }
+
+    compact_linked_functions(program);
+
+    if (removed > 0) {
+        if (get_compiler_options()->report == TRUE) {
+            printf("tree shaking: removed %d of %d functions, %d instructions\n", removed, linked_function_count, removed_instructions);
+        }
+    }
+    free(linked_functions);
+    linked_functions = NULL;
+    linked_function_count = 0;
+    return removed;
+}
+
+// hottest first, then the functions the profile does not know, never-called ones last
+int function_temperature(LinkedFunction *function) {
+    long long count = profile_function_count(function->file->code[function->start].name);
+    return count > 0 ? 0 : count < 0 ? 1 : 2;
+}
+
+int order_functions(VmProgram *program) {
+    if (has_profile() == FALSE) {
+        return 0;
+    }
+    collect_linked_functions(program);
+
+    int moved = 0;
+    int first = 0;
+    for (int i = 0; i < program->size; i++) {
+        VmFile *file = &program->files[i];
+        int last = first;
+        while (last < linked_function_count && linked_functions[last].file == file) {
+            last += 1;
+        }
+
+        // stable selection by temperature, hot functions by falling call count
+        int count = last - first;
+        int *order = (int *)malloc(sizeof(int) * (count + 1));
+        char *taken = (char *)calloc(count + 1, sizeof(char));
+        for (int k = 0; k < count; k++) {
+            int best = -1;
+            for (int f = 0; f < count; f++) {
+                if (taken[f] == TRUE) {
+                    continue;
+                }
+                if (best < 0) {
+                    best = f;
+                    continue;
+                }
+                LinkedFunction *candidate = &linked_functions[first + f];
+                LinkedFunction *current = &linked_functions[first + best];
+                int a = function_temperature(candidate);
+                int b = function_temperature(current);
+                if (a < b || (a == 0 && b == 0 && profile_function_count(candidate->file->code[candidate->start].name) >
+                                                      profile_function_count(current->file->code[current->start].name))) {
+                    best = f;
+                }
+            }
+            taken[best] = TRUE;
+            order[k] = best;
+            if (best != k) {
+                moved += 1;
+            }
+        }
+
+        VmFile output = *file;
+        output.size = 0;
+        output.capacity = file->size + 1;
+        output.code = (VmInstruction *)malloc(sizeof(VmInstruction) * output.capacity);
+        for (int j = 0; count > 0 && j < linked_functions[first].start; j++) {
+            append_instruction(&output, file->code[j]);
+        }
+        for (int k = 0; k < count; k++) {
+            LinkedFunction *function = &linked_functions[first + order[k]];
+            for (int j = function->start; j < function->end; j++) {
+                append_instruction(&output, file->code[j]);
+            }
+        }
+        if (count > 0) {
+            free(file->code);
+            file->code = output.code;
+            file->size = output.size;
+            file->capacity = output.capacity;
+        } else {
+            free(output.code);
+        }
+        free(order);
+        free(taken);
+        first = last;
+    }
+
+    if (moved > 0) {
+        if (get_compiler_options()->report == TRUE) {
+            printf("profile: reordered %d functions hot to cold\n", moved);
+        }
+    }
+    free(linked_functions);
+    linked_functions = NULL;
+    linked_function_count = 0;
+    return moved;
+}
+
+// a function body with its own name and its labels replaced, so copies in other classes compare equal
+typedef struct {
+    VmInstruction *code;
+    int size;
+    unsigned int hash;
+    int uses_statics;  // statics belong to the class, such bodies only fold within one file
+} FoldedBody;
+
+int same_vm_instruction(VmInstruction *a, VmInstruction *b) {
+    if (a->cmd != b->cmd) {
+        return FALSE;
+    }
+    switch (a->cmd) {
+        case PUSH_CM:
+        case POP_CM:
+            return a->seg == b->seg && a->idx == b->idx;
+        case LABEL_CM:
+        case GOTO_CM:
+        case IF_GOTO_CM:
+            return strcmp(a->name, b->name) == 0;
+        case FUNCTION_CM:
+        case CALL_CM:
+            return a->idx == b->idx && strcmp(a->name, b->name) == 0;
+        default:
+            return TRUE;
+    }
+}
+
+// FNV-1a over the fields same_vm_instruction compares
+unsigned int hash_vm_instruction(unsigned int hash, VmInstruction *instruction) {
+    int fields[3] = {instruction->cmd, 0, 0};
+    if (instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) {
+        fields[1] = instruction->seg;
+    }
+    if (instruction->cmd == PUSH_CM || instruction->cmd == POP_CM || instruction->cmd == FUNCTION_CM || instruction->cmd == CALL_CM) {
+        fields[2] = instruction->idx;
+    }
+    for (int k = 0; k < 3; k++) {
+        hash = (hash ^ (unsigned int)fields[k]) * 16777619u;
+    }
+    if (instruction->cmd >= LABEL_CM && instruction->cmd != RETURN_CM) {
+        for (char *c = instruction->name; *c != '\0'; c++) {
+            hash = (hash ^ (unsigned char)*c) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// labels are numbered by first appearance and calls to the function itself name no class
+void normalize_function_body(LinkedFunction *function, FoldedBody *body) {
+    char *self = function->file->code[function->start].name;
+    body->size = function->end - function->start;
+    body->code = (VmInstruction *)malloc(sizeof(VmInstruction) * body->size);
+    body->hash = 2166136261u;
+    body->uses_statics = FALSE;
+
+    char **labels = (char **)malloc(sizeof(char *) * body->size);
+    int label_count = 0;
+    for (int j = 0; j < body->size; j++) {
+        VmInstruction instruction = function->file->code[function->start + j];
+        if (instruction.cmd == FUNCTION_CM || (instruction.cmd == CALL_CM && strcmp(instruction.name, self) == 0)) {
+            strcpy(instruction.name, "$self");
+        } else if (instruction.cmd == LABEL_CM || instruction.cmd == GOTO_CM || instruction.cmd == IF_GOTO_CM) {
+            int k = 0;
+            while (k < label_count && strcmp(labels[k], function->file->code[function->start + j].name) != 0) {
+                k += 1;
+            }
+            if (k == label_count) {
+                labels[k] = function->file->code[function->start + j].name;
+                label_count += 1;
+            }
+            snprintf(instruction.name, VM_NAME_LEN, "L%d", k);
+        } else if ((instruction.cmd == PUSH_CM || instruction.cmd == POP_CM) && instruction.seg == STATIC_SEG) {
+            body->uses_statics = TRUE;
+        }
+        body->code[j] = instruction;
+        body->hash = hash_vm_instruction(body->hash, &instruction);
+    }
+    free(labels);
+}
+
+int same_function_body(FoldedBody *a, FoldedBody *b) {
+    if (a->hash != b->hash || a->size != b->size) {
+        return FALSE;
+    }
+    for (int j = 0; j < a->size; j++) {
+        if (same_vm_instruction(&a->code[j], &b->code[j]) == FALSE) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// the body of a folded function in a library: pass the arguments it reads on to the copy that stays
+void append_function_alias(VmFile *output, LinkedFunction *function, char *target) {
+    int args = 0;
+    for (int j = function->start + 1; j < function->end; j++) {
+        VmInstruction *instruction = &function->file->code[j];
+        if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == ARGUMENT_SEG && instruction->idx + 1 > args) {
+            args = instruction->idx + 1;
+        }
+    }
+
+    VmInstruction instruction = function->file->code[function->start];
+    instruction.idx = 0;
+    append_instruction(output, instruction);
+    for (int i = 0; i < args; i++) {
+        instruction = temp_access(PUSH_CM, i);
+        instruction.seg = ARGUMENT_SEG;
+        append_instruction(output, instruction);
+    }
+    instruction = temp_access(CALL_CM, args);
+    strcpy(instruction.name, target);
+    append_instruction(output, instruction);
+    instruction = temp_access(RETURN_CM, 0);
+    append_instruction(output, instruction);
+}
+
+// one round of folding, returns the number of functions folded into an earlier copy
+int fold_round(VmProgram *program, int has_entry) {
+    collect_linked_functions(program);
+    int has_sys_init = find_linked_function("Sys.init") >= 0;
+
+    FoldedBody *bodies = (FoldedBody *)malloc(sizeof(FoldedBody) * (linked_function_count + 1));
+    int *canonical = (int *)malloc(sizeof(int) * (linked_function_count + 1));
+    int folded = 0;
+    int folded_instructions = 0;
+    for (int i = 0; i < linked_function_count; i++) {
+        LinkedFunction *function = &linked_functions[i];
+        normalize_function_body(function, &bodies[i]);
+        canonical[i] = i;
+
+        // functions called by name from outside the program have to stay
+        char *name = function->file->code[function->start].name;
+        if (is_external_function(name, has_sys_init) == TRUE) {
+            continue;
+        }
+        for (int k = 0; k < i; k++) {
+            if (canonical[k] == k && same_function_body(&bodies[k], &bodies[i]) == TRUE &&
+                (bodies[i].uses_statics == FALSE || linked_functions[k].file == function->file)) {
+                canonical[i] = k;
+                if (get_compiler_options()->report == TRUE) {
+                    printf("folding: %s into %s\n", name, linked_functions[k].file->code[linked_functions[k].start].name);
+                }
+                folded += 1;
+                folded_instructions += function->end - function->start;
+                break;
+            }
+        }
+    }
+
+    if (folded > 0) {
+        // callers go straight to the copy that stays
+        for (int i = 0; i < program->size; i++) {
+            VmFile *file = &program->files[i];
+            for (int j = 0; j < file->size; j++) {
+                if (file->code[j].cmd != CALL_CM) {
+                    continue;
+                }
+                int callee = find_linked_function(file->code[j].name);
+                if (callee >= 0 && canonical[callee] != callee) {
+                    LinkedFunction *target = &linked_functions[canonical[callee]];
+                    strcpy(file->code[j].name, target->file->code[target->start].name);
+                }
+            }
+        }
+
+        if (has_entry == TRUE) {
+            for (int i = 0; i < linked_function_count; i++) {
+                linked_functions[i].reachable = canonical[i] == i;
+            }
+            compact_linked_functions(program);
+        } else {
+            // a library keeps every name, callers outside the program may still use the folded ones
+            int next = 0;
+            for (int i = 0; i < program->size; i++) {
+                VmFile *file = &program->files[i];
+                VmFile output = *file;
+                output.size = 0;
+                output.capacity = file->size + 1;
+                output.code = (VmInstruction *)malloc(sizeof(VmInstruction) * output.capacity);
+                int j = 0;
+                while (j < file->size) {
+                    if (next < linked_function_count && linked_functions[next].file == file && linked_functions[next].start == j) {
+                        LinkedFunction *function = &linked_functions[next];
+                        if (canonical[next] != next) {
+                            LinkedFunction *target = &linked_functions[canonical[next]];
+                            int mark = output.size;
+                            append_function_alias(&output, function, target->file->code[target->start].name);
+                            folded_instructions -= output.size - mark;
+                            j = function->end;
+                            next += 1;
+                            continue;
+                        }
+                        next += 1;
+                    }
+                    append_instruction(&output, file->code[j]);
+                    j += 1;
+                }
+                free(file->code);
+                file->code = output.code;
+                file->size = output.size;
+                file->capacity = output.capacity;
+            }
+        }
+        if (get_compiler_options()->report == TRUE) {
+            printf("folding: %d duplicate functions, %d instructions\n", folded, folded_instructions);
+        }
+    }
+
+    for (int i = 0; i < linked_function_count; i++) {
+        free(bodies[i].code);
+    }
+    free(bodies);
+    free(canonical);
+    free(linked_functions);
+    linked_functions = NULL;
+    linked_function_count = 0;
+    return folded;
+}
+
+int fold_identical_functions(VmProgram *program) {
+    collect_linked_functions(program);
+    int has_entry = find_linked_function("Sys.init") >= 0 || find_linked_function("Main.main") >= 0;
+
+    // callers that now call the same copies can be identical in the next round, aliases are not folded again
+    int folded = 0;
+    for (int round = 0; round < (has_entry == TRUE ? 4 : 1); round++) {
+        int count = fold_round(program, has_entry);
+        if (count == 0) {
+            break;
+        }
+        folded += count;
+    }
+    return folded;
+}
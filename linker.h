@@ -0,0 +1,20 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include "vmcode.h"
+
+// whole-program passes that run over every generated class at once
+
+// drop every function not reachable from Sys.init or Main.main, returns the number removed
+int shake_tree(VmProgram *program);
+
+// expand calls of small straight-line leaf functions in place, returns the number of call sites inlined
+int inline_functions(VmProgram *program, int budget);
+
+// with a profile loaded, put every class's functions in order of falling call count, returns the number moved
+int order_functions(VmProgram *program);
+
+// merge functions whose bodies are identical up to their names and labels, returns the number folded
+int fold_identical_functions(VmProgram *program);
+
+#endif
@@ -0,0 +1,235 @@
+#include "manifest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "dirent.h"
+#include "interface.h"
+#include "symbols.h"
+
+#define TRUE 1
+#define FALSE 0
+
+BuildManifest previous_manifest = {0, 0, NULL, 0, 0};
+BuildManifest current_manifest = {0, 0, NULL, 0, 0};
+
+void free_manifest(BuildManifest *manifest) {
+    for (int i = 0; i < manifest->size; i++) {
+        free(manifest->classes[i].references);
+    }
+    free(manifest->classes);
+    manifest->classes = NULL;
+    manifest->size = 0;
+    manifest->capacity = 0;
+}
+
+ManifestClass *add_manifest_class(BuildManifest *manifest) {
+    if (manifest->size == manifest->capacity) {
+        manifest->capacity = manifest->capacity == 0 ? 16 : manifest->capacity * 2;
+        manifest->classes = (ManifestClass *)realloc(manifest->classes, sizeof(ManifestClass) * manifest->capacity);
+    }
+    ManifestClass *class = &manifest->classes[manifest->size];
+    memset(class, 0, sizeof(ManifestClass));
+    manifest->size += 1;
+    return class;
+}
+
+ManifestClass *find_manifest_class(BuildManifest *manifest, char *name) {
+    for (int i = 0; i < manifest->size; i++) {
+        if (strcmp(manifest->classes[i].name, name) == 0) {
+            return &manifest->classes[i];
+        }
+    }
+    return NULL;
+}
+
+ManifestClass *find_manifest_file(BuildManifest *manifest, char *file) {
+    for (int i = 0; i < manifest->size; i++) {
+        if (strcmp(manifest->classes[i].file, file) == 0) {
+            return &manifest->classes[i];
+        }
+    }
+    return NULL;
+}
+
+void build_code_path(char *path, int size, char *dir_name, char *file_name) {
+    snprintf(path, size, "%s/%s/%s", dir_name, BUILD_DIR, file_name);
+    char *dot = strrchr(path, '.');
+    if (dot != NULL && strcmp(dot, ".jack") == 0) {
+        strcpy(dot, ".vm");
+    }
+}
+
+// one header line, then one line per class: file, name, hashes and the classes it names
+int read_build_manifest(char *path, BuildManifest *manifest) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return FALSE;
+    }
+    int version = 0;
+    if (fscanf(file, "jack-manifest %d %llx %llx", &version, &manifest->compiler_hash, &manifest->library_hash) != 3 || version != 1) {
+        fclose(file);
+        return FALSE;
+    }
+    ManifestClass class;
+    while (fscanf(file, " class %255s %127s %llx %llx %d", class.file, class.name, &class.source_hash, &class.interface_hash, &class.reference_count) == 5) {
+        ManifestClass *entry = add_manifest_class(manifest);
+        *entry = class;
+        entry->references = (char(*)[128])malloc(sizeof(*entry->references) * (class.reference_count + 1));
+        for (int i = 0; i < class.reference_count; i++) {
+            if (fscanf(file, " %127s", entry->references[i]) != 1) {
+                entry->reference_count = i;
+                break;
+            }
+        }
+    }
+    fclose(file);
+    return TRUE;
+}
+
+// a file is affected when it is new or edited, its code from the last build is gone,
+// or a program class it names changed its interface or disappeared
+int is_manifest_class_affected(ManifestClass *class, char *dir_name) {
+    ManifestClass *previous = find_manifest_file(&previous_manifest, class->file);
+    if (previous == NULL || previous->source_hash != class->source_hash || strcmp(previous->name, class->name) != 0) {
+        return TRUE;
+    }
+
+    char path[1024];
+    build_code_path(path, sizeof(path), dir_name, class->file);
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        return TRUE;
+    }
+
+    // library classes are covered by the library hash
+    for (int i = 0; i < previous->reference_count; i++) {
+        ManifestClass *reference = find_manifest_class(&previous_manifest, previous->references[i]);
+        if (reference == NULL) {
+            continue;
+        }
+        ManifestClass *now = find_manifest_class(&current_manifest, reference->name);
+        if (now == NULL || now->interface_hash != reference->interface_hash) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// compare the declarations just skimmed from every file of dir_name with the manifest of the last build,
+// returns the number of files to check and generate again
+int plan_incremental_build(char *dir_name, unsigned long long library_hash) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s/manifest", dir_name, BUILD_DIR);
+    free_manifest(&previous_manifest);
+    free_manifest(&current_manifest);
+    int has_previous = read_build_manifest(path, &previous_manifest);
+    current_manifest.compiler_hash = compiler_hash();
+    current_manifest.library_hash = library_hash;
+    int everything = has_previous == FALSE || previous_manifest.compiler_hash != current_manifest.compiler_hash ||
+                     previous_manifest.library_hash != library_hash;
+
+    snprintf(path, sizeof(path), "%s/%s", dir_name, BUILD_DIR);
+    mkdir(path, 0755);
+
+    DIR *dir = opendir(dir_name);
+    if (dir == NULL) {
+        return 0;
+    }
+    index_class_interfaces();
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strstr(entry->d_name, ".jack") == NULL || strlen(entry->d_name) >= sizeof(current_manifest.classes[0].file)) {
+            continue;
+        }
+        ManifestClass *class = add_manifest_class(&current_manifest);
+        strcpy(class->file, entry->d_name);
+        snprintf(class->name, sizeof(class->name), "%s", entry->d_name);
+        char *dot = strrchr(class->name, '.');
+        if (dot != NULL) {
+            *dot = '\0';
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", dir_name, entry->d_name);
+        long size = 0;
+        char *source = read_source_file(path, &size);
+        if (source == NULL) {
+            class->affected = TRUE;
+            continue;
+        }
+        class->source_hash = hash_bytes(14695981039346656037ull, source, size);
+
+        // a class declared under another name than its file is always rebuilt, interface 0 marks it
+        int order = find_indexed_class(class->name);
+        class->interface_hash = order >= 0 ? indexed_interface_hash(order) : 0;
+        class->affected = order < 0;
+
+        char *referenced = find_referenced_classes(source, size);
+        SymbolTable *program_table = get_program_table();
+        class->references = (char(*)[128])malloc(sizeof(*class->references) * (program_table->size + 1));
+        for (int i = 0; i < program_table->size; i++) {
+            if (referenced[i] == TRUE && i != order) {
+                snprintf(class->references[class->reference_count], sizeof(*class->references), "%s", program_table->rows[i]->token.lx);
+                class->reference_count += 1;
+            }
+        }
+        free(source);
+    }
+    closedir(dir);
+    free_class_interfaces();
+
+    int affected = 0;
+    for (int i = 0; i < current_manifest.size; i++) {
+        ManifestClass *class = &current_manifest.classes[i];
+        if (everything == TRUE || class->affected == TRUE || is_manifest_class_affected(class, dir_name) == TRUE) {
+            class->affected = TRUE;
+            affected += 1;
+        }
+    }
+    printf("incremental: %d of %d classes to rebuild\n", affected, current_manifest.size);
+    return affected;
+}
+
+// files the plan does not know, e.g. with an over long name, are rebuilt
+int is_file_affected(char *file_name) {
+    ManifestClass *class = find_manifest_file(&current_manifest, file_name);
+    return class == NULL || class->affected == TRUE;
+}
+
+// record the build that just succeeded, every file's code before optimization is in the build directory by now
+int write_build_manifest(char *dir_name) {
+    char path[1024];
+    char temporary[1100];
+    snprintf(path, sizeof(path), "%s/%s/manifest", dir_name, BUILD_DIR);
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE *file = fopen(temporary, "w");
+    if (file == NULL) {
+        printf("can not write build manifest %s\n", path);
+        discard_build_manifest();
+        return FALSE;
+    }
+    fprintf(file, "jack-manifest 1 %016llx %016llx\n", current_manifest.compiler_hash, current_manifest.library_hash);
+    for (int i = 0; i < current_manifest.size; i++) {
+        ManifestClass *class = &current_manifest.classes[i];
+        fprintf(file, "class %s %s %016llx %016llx %d", class->file, class->name, class->source_hash, class->interface_hash, class->reference_count);
+        for (int j = 0; j < class->reference_count; j++) {
+            fprintf(file, " %s", class->references[j]);
+        }
+        fprintf(file, "\n");
+    }
+    int ok = fclose(file) == 0 && rename(temporary, path) == 0;
+    if (ok == FALSE) {
+        printf("can not write build manifest %s\n", path);
+        remove(temporary);
+    }
+    discard_build_manifest();
+    return ok;
+}
+
+void discard_build_manifest() {
+    free_manifest(&previous_manifest);
+    free_manifest(&current_manifest);
+}
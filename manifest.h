@@ -0,0 +1,32 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+// what the last build of a directory saw, so the next one only checks and generates the classes a change can affect
+
+#define BUILD_DIR ".jcbuild"  // inside the program directory, holds the manifest and every class's code before optimization
+
+typedef struct {
+    char file[256];  // Class.jack
+    char name[128];
+    unsigned long long source_hash;
+    unsigned long long interface_hash;
+    char (*references)[128];  // classes the source names, besides itself
+    int reference_count;
+    int affected;
+} ManifestClass;
+
+typedef struct {
+    unsigned long long compiler_hash;
+    unsigned long long library_hash;
+    ManifestClass *classes;
+    int size;
+    int capacity;
+} BuildManifest;
+
+int plan_incremental_build(char *dir_name, unsigned long long library_hash);
+int is_file_affected(char *file_name);
+void build_code_path(char *path, int size, char *dir_name, char *file_name);
+int write_build_manifest(char *dir_name);
+void discard_build_manifest();
+
+#endif
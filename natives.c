@@ -0,0 +1,625 @@
+#include "natives.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define HEAP_END 16384
+#define SCREEN_BASE 16384
+#define KEYBOARD 24576
+
+// strings are a single heap block laid out as [capacity, length, chars...]
+#define STRING_CAPACITY 0
+#define STRING_LENGTH 1
+#define STRING_CHARS 2
+
+#define NEW_LINE 128
+#define BACK_SPACE 129
+#define DOUBLE_QUOTE 34
+
+int sys_error(Interpreter *vm, int code) {
+    printf("ERR%d\n", code);
+    vm->halted = TRUE;
+    return 0;
+}
+
+// a guest address a native can not use, fails the run instead of touching host memory
+int guest_fault(Interpreter *vm, int address) {
+    printf("bad address %d\n", address);
+    vm->halted = TRUE;
+    vm->faulted = TRUE;
+    return 0;
+}
+
+// a heap block whose length word keeps it inside the heap
+int is_heap_block(Interpreter *vm, int block) {
+    return block >= HEAP_BASE && block < HEAP_END - 1 && vm->ram[block] >= 2 && vm->ram[block] <= HEAP_END - block;
+}
+
+// the string at address with its header and every character up to its capacity in RAM, NULL after a fault
+int16_t *guest_string(Interpreter *vm, int address) {
+    if (address < 0 || address > RAM_SIZE - STRING_CHARS) {
+        guest_fault(vm, address);
+        return NULL;
+    }
+    int16_t *string = vm->ram + address;
+    if (string[STRING_CAPACITY] < 0 || string[STRING_CAPACITY] > RAM_SIZE - STRING_CHARS - address ||
+        string[STRING_LENGTH] < 0 || string[STRING_LENGTH] > string[STRING_CAPACITY]) {
+        guest_fault(vm, address);
+        return NULL;
+    }
+    return string;
+}
+
+// heap blocks carry their length (header included) in the word before the object,
+// free blocks keep the address of the next free block in their second word
+void reset_natives(Interpreter *vm) {
+    vm->heap_free = HEAP_BASE;
+    vm->ram[HEAP_BASE] = HEAP_END - HEAP_BASE;
+    vm->ram[HEAP_BASE + 1] = 0;
+    vm->halted = FALSE;
+    vm->faulted = FALSE;
+    vm->color = -1;
+}
+
+int heap_alloc(Interpreter *vm, int size) {
+    int16_t *ram = vm->ram;
+    int needed = size + 1 < 2 ? 2 : size + 1;
+    int prev = 0;
+    int block = vm->heap_free;
+
+    while (block != 0) {
+        // the guest can overwrite the free list like any other memory
+        if (is_heap_block(vm, block) == FALSE) {
+            return guest_fault(vm, block);
+        }
+        int length = ram[block];
+        int next = ram[block + 1];
+        if (length >= needed) {
+            if (length - needed >= 3) {
+                // split, the tail stays on the free list
+                int rest = block + needed;
+                ram[rest] = length - needed;
+                ram[rest + 1] = next;
+                next = rest;
+                ram[block] = needed;
+            }
+            if (prev == 0) {
+                vm->heap_free = next;
+            } else {
+                ram[prev + 1] = next;
+            }
+            return block + 1;
+        }
+        prev = block;
+        block = next;
+    }
+    return sys_error(vm, 6);
+}
+
+void heap_free(Interpreter *vm, int object) {
+    int16_t *ram = vm->ram;
+    int block = object - 1;
+    if (is_heap_block(vm, block) == FALSE) {
+        guest_fault(vm, object);
+        return;
+    }
+
+    // keep the free list sorted by address so neighbours can be merged
+    int prev = 0;
+    int next = vm->heap_free;
+    while (next != 0 && next < block) {
+        if (is_heap_block(vm, next) == FALSE) {
+            guest_fault(vm, next);
+            return;
+        }
+        prev = next;
+        next = ram[next + 1];
+    }
+    if (next != 0 && is_heap_block(vm, next) == FALSE) {
+        guest_fault(vm, next);
+        return;
+    }
+
+    ram[block + 1] = next;
+    if (next != 0 && block + ram[block] == next) {
+        ram[block] += ram[next];
+        ram[block + 1] = ram[next + 1];
+    }
+    if (prev == 0) {
+        vm->heap_free = block;
+    } else {
+        ram[prev + 1] = block;
+        if (prev + ram[prev] == block) {
+            ram[prev] += ram[block];
+            ram[prev + 1] = ram[block + 1];
+        }
+    }
+}
+
+int math_init(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return 0;
+}
+
+int math_abs(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    return args[0] < 0 ? -args[0] : args[0];
+}
+
+int math_multiply(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    return args[0] * args[1];
+}
+
+int math_divide(Interpreter *vm, int16_t *args) {
+    if (args[1] == 0) {
+        return sys_error(vm, 3);
+    }
+    return args[0] / args[1];
+}
+
+int math_min(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    return args[0] < args[1] ? args[0] : args[1];
+}
+
+int math_max(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    return args[0] > args[1] ? args[0] : args[1];
+}
+
+int math_sqrt(Interpreter *vm, int16_t *args) {
+    if (args[0] < 0) {
+        return sys_error(vm, 4);
+    }
+    int root = 0;
+    while ((root + 1) * (root + 1) <= args[0]) {
+        root += 1;
+    }
+    return root;
+}
+
+int memory_init(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return 0;
+}
+
+int memory_peek(Interpreter *vm, int16_t *args) {
+    return vm->ram[args[0] & RAM_MASK];
+}
+
+int memory_poke(Interpreter *vm, int16_t *args) {
+    vm->ram[args[0] & RAM_MASK] = args[1];
+    return 0;
+}
+
+int memory_alloc(Interpreter *vm, int16_t *args) {
+    if (args[0] <= 0) {
+        return sys_error(vm, 5);
+    }
+    return heap_alloc(vm, args[0]);
+}
+
+int memory_de_alloc(Interpreter *vm, int16_t *args) {
+    heap_free(vm, args[0]);
+    return 0;
+}
+
+int array_new(Interpreter *vm, int16_t *args) {
+    if (args[0] <= 0) {
+        return sys_error(vm, 2);
+    }
+    return heap_alloc(vm, args[0]);
+}
+
+int array_dispose(Interpreter *vm, int16_t *args) {
+    heap_free(vm, args[0]);
+    return 0;
+}
+
+int new_string(Interpreter *vm, int capacity) {
+    int string = heap_alloc(vm, capacity + STRING_CHARS);
+    if (vm->halted == TRUE) {
+        return 0;
+    }
+    vm->ram[string + STRING_CAPACITY] = capacity;
+    vm->ram[string + STRING_LENGTH] = 0;
+    return string;
+}
+
+int string_new(Interpreter *vm, int16_t *args) {
+    if (args[0] < 0) {
+        return sys_error(vm, 14);
+    }
+    return new_string(vm, args[0]);
+}
+
+int string_dispose(Interpreter *vm, int16_t *args) {
+    heap_free(vm, args[0]);
+    return 0;
+}
+
+int string_length(Interpreter *vm, int16_t *args) {
+    int16_t *string = guest_string(vm, args[0]);
+    return string != NULL ? string[STRING_LENGTH] : 0;
+}
+
+int string_char_at(Interpreter *vm, int16_t *args) {
+    int16_t *string = guest_string(vm, args[0]);
+    if (string == NULL) {
+        return 0;
+    }
+    if (args[1] < 0 || args[1] >= string[STRING_LENGTH]) {
+        return sys_error(vm, 15);
+    }
+    return string[STRING_CHARS + args[1]];
+}
+
+int string_set_char_at(Interpreter *vm, int16_t *args) {
+    int16_t *string = guest_string(vm, args[0]);
+    if (string == NULL) {
+        return 0;
+    }
+    if (args[1] < 0 || args[1] >= string[STRING_LENGTH]) {
+        return sys_error(vm, 16);
+    }
+    string[STRING_CHARS + args[1]] = args[2];
+    return 0;
+}
+
+int string_append_char(Interpreter *vm, int16_t *args) {
+    int16_t *string = guest_string(vm, args[0]);
+    if (string == NULL) {
+        return 0;
+    }
+    if (string[STRING_LENGTH] >= string[STRING_CAPACITY]) {
+        return sys_error(vm, 17);
+    }
+    string[STRING_CHARS + string[STRING_LENGTH]] = args[1];
+    string[STRING_LENGTH] += 1;
+    return args[0];
+}
+
+int string_erase_last_char(Interpreter *vm, int16_t *args) {
+    int16_t *string = guest_string(vm, args[0]);
+    if (string == NULL) {
+        return 0;
+    }
+    if (string[STRING_LENGTH] == 0) {
+        return sys_error(vm, 18);
+    }
+    string[STRING_LENGTH] -= 1;
+    return 0;
+}
+
+int string_int_value(Interpreter *vm, int16_t *args) {
+    int16_t *string = guest_string(vm, args[0]);
+    if (string == NULL) {
+        return 0;
+    }
+    int value = 0;
+    int i = 0;
+    int negative = string[STRING_LENGTH] > 0 && string[STRING_CHARS] == '-';
+    if (negative) {
+        i = 1;
+    }
+    while (i < string[STRING_LENGTH] && string[STRING_CHARS + i] >= '0' && string[STRING_CHARS + i] <= '9') {
+        value = value * 10 + (string[STRING_CHARS + i] - '0');
+        i += 1;
+    }
+    return negative ? -value : value;
+}
+
+int string_set_int(Interpreter *vm, int16_t *args) {
+    int16_t *string = guest_string(vm, args[0]);
+    if (string == NULL) {
+        return 0;
+    }
+    char digits[8];
+    int length = snprintf(digits, sizeof(digits), "%d", args[1]);
+    if (length > string[STRING_CAPACITY]) {
+        return sys_error(vm, 19);
+    }
+    for (int i = 0; i < length; i++) {
+        string[STRING_CHARS + i] = digits[i];
+    }
+    string[STRING_LENGTH] = length;
+    return 0;
+}
+
+int string_back_space(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return BACK_SPACE;
+}
+
+int string_double_quote(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return DOUBLE_QUOTE;
+}
+
+int string_new_line(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return NEW_LINE;
+}
+
+void put_jack_char(int c) {
+    if (c == NEW_LINE) {
+        putchar('\n');
+    } else if (c == BACK_SPACE) {
+        putchar('\b');
+    } else {
+        putchar(c);
+    }
+}
+
+int output_init(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return 0;
+}
+
+int output_move_cursor(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return 0;
+}
+
+int output_print_char(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    put_jack_char(args[0]);
+    return 0;
+}
+
+int output_print_string(Interpreter *vm, int16_t *args) {
+    int16_t *string = guest_string(vm, args[0]);
+    if (string == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < string[STRING_LENGTH]; i++) {
+        put_jack_char(string[STRING_CHARS + i]);
+    }
+    return 0;
+}
+
+int output_print_int(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    printf("%d", args[0]);
+    return 0;
+}
+
+int output_println(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    putchar('\n');
+    return 0;
+}
+
+int output_back_space(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    putchar('\b');
+    return 0;
+}
+
+void draw_pixel(Interpreter *vm, int x, int y) {
+    if (x < 0 || x >= 512 || y < 0 || y >= 256) {
+        return;
+    }
+    int address = SCREEN_BASE + y * 32 + x / 16;
+    int16_t mask = (int16_t)(1 << (x % 16));
+    if (vm->color) {
+        vm->ram[address] |= mask;
+    } else {
+        vm->ram[address] &= ~mask;
+    }
+}
+
+int screen_init(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return 0;
+}
+
+int screen_clear_screen(Interpreter *vm, int16_t *args) {
+    (void)args;
+    memset(vm->ram + SCREEN_BASE, 0, sizeof(int16_t) * (KEYBOARD - SCREEN_BASE));
+    return 0;
+}
+
+int screen_set_color(Interpreter *vm, int16_t *args) {
+    vm->color = args[0];
+    return 0;
+}
+
+int screen_draw_pixel(Interpreter *vm, int16_t *args) {
+    draw_pixel(vm, args[0], args[1]);
+    return 0;
+}
+
+int screen_draw_line(Interpreter *vm, int16_t *args) {
+    int x = args[0];
+    int y = args[1];
+    int dx = abs(args[2] - x);
+    int dy = -abs(args[3] - y);
+    int step_x = x < args[2] ? 1 : -1;
+    int step_y = y < args[3] ? 1 : -1;
+    int error = dx + dy;
+
+    while (TRUE) {
+        draw_pixel(vm, x, y);
+        if (x == args[2] && y == args[3]) {
+            break;
+        }
+        int twice = 2 * error;
+        if (twice >= dy) {
+            error += dy;
+            x += step_x;
+        }
+        if (twice <= dx) {
+            error += dx;
+            y += step_y;
+        }
+    }
+    return 0;
+}
+
+int screen_draw_rectangle(Interpreter *vm, int16_t *args) {
+    for (int y = args[1]; y <= args[3]; y++) {
+        for (int x = args[0]; x <= args[2]; x++) {
+            draw_pixel(vm, x, y);
+        }
+    }
+    return 0;
+}
+
+int screen_draw_circle(Interpreter *vm, int16_t *args) {
+    int r = args[2];
+    for (int dy = -r; dy <= r; dy++) {
+        for (int dx = -r; dx <= r; dx++) {
+            if (dx * dx + dy * dy <= r * r) {
+                draw_pixel(vm, args[0] + dx, args[1] + dy);
+            }
+        }
+    }
+    return 0;
+}
+
+int keyboard_init(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    return 0;
+}
+
+int keyboard_key_pressed(Interpreter *vm, int16_t *args) {
+    (void)args;
+    return vm->ram[KEYBOARD];
+}
+
+int keyboard_read_char(Interpreter *vm, int16_t *args) {
+    (void)vm;
+    (void)args;
+    int c = getchar();
+    if (c == '\n') {
+        return NEW_LINE;
+    }
+    return c == EOF ? 0 : c;
+}
+
+// headless line input from stdin, the prompt is echoed like the Jack OS does
+int read_line(Interpreter *vm, int16_t prompt, char *line, int size) {
+    output_print_string(vm, &prompt);
+    if (fgets(line, size, stdin) == NULL) {
+        line[0] = '\0';
+    }
+    line[strcspn(line, "\n")] = '\0';
+    return (int)strlen(line);
+}
+
+int keyboard_read_line(Interpreter *vm, int16_t *args) {
+    char line[256];
+    int length = read_line(vm, args[0], line, sizeof(line));
+    int string = new_string(vm, length);
+    for (int i = 0; i < length && vm->halted == FALSE; i++) {
+        vm->ram[string + STRING_CHARS + i] = line[i];
+    }
+    if (vm->halted == FALSE) {
+        vm->ram[string + STRING_LENGTH] = length;
+    }
+    return string;
+}
+
+int keyboard_read_int(Interpreter *vm, int16_t *args) {
+    char line[256];
+    read_line(vm, args[0], line, sizeof(line));
+    return atoi(line);
+}
+
+int sys_halt(Interpreter *vm, int16_t *args) {
+    (void)args;
+    vm->halted = TRUE;
+    return 0;
+}
+
+int sys_error_native(Interpreter *vm, int16_t *args) {
+    return sys_error(vm, args[0]);
+}
+
+int sys_wait(Interpreter *vm, int16_t *args) {
+    if (args[0] <= 0) {
+        return sys_error(vm, 1);
+    }
+    return 0;
+}
+
+NativeEntry native_table[] = {
+    {"Math.init", 0, math_init},
+    {"Math.abs", 1, math_abs},
+    {"Math.multiply", 2, math_multiply},
+    {"Math.divide", 2, math_divide},
+    {"Math.min", 2, math_min},
+    {"Math.max", 2, math_max},
+    {"Math.sqrt", 1, math_sqrt},
+    {"Memory.init", 0, memory_init},
+    {"Memory.peek", 1, memory_peek},
+    {"Memory.poke", 2, memory_poke},
+    {"Memory.alloc", 1, memory_alloc},
+    {"Memory.deAlloc", 1, memory_de_alloc},
+    {"Array.new", 1, array_new},
+    {"Array.dispose", 1, array_dispose},
+    {"String.new", 1, string_new},
+    {"String.dispose", 1, string_dispose},
+    {"String.length", 1, string_length},
+    {"String.charAt", 2, string_char_at},
+    {"String.setCharAt", 3, string_set_char_at},
+    {"String.appendChar", 2, string_append_char},
+    {"String.eraseLastChar", 1, string_erase_last_char},
+    {"String.intValue", 1, string_int_value},
+    {"String.setInt", 2, string_set_int},
+    {"String.backSpace", 0, string_back_space},
+    {"String.doubleQuote", 0, string_double_quote},
+    {"String.newLine", 0, string_new_line},
+    {"Output.init", 0, output_init},
+    {"Output.moveCursor", 2, output_move_cursor},
+    {"Output.printChar", 1, output_print_char},
+    {"Output.printString", 1, output_print_string},
+    {"Output.printInt", 1, output_print_int},
+    {"Output.println", 0, output_println},
+    {"Output.backSpace", 0, output_back_space},
+    {"Screen.init", 0, screen_init},
+    {"Screen.clearScreen", 0, screen_clear_screen},
+    {"Screen.setColor", 1, screen_set_color},
+    {"Screen.drawPixel", 2, screen_draw_pixel},
+    {"Screen.drawLine", 4, screen_draw_line},
+    {"Screen.drawRectangle", 4, screen_draw_rectangle},
+    {"Screen.drawCircle", 3, screen_draw_circle},
+    {"Keyboard.init", 0, keyboard_init},
+    {"Keyboard.keyPressed", 0, keyboard_key_pressed},
+    {"Keyboard.readChar", 0, keyboard_read_char},
+    {"Keyboard.readLine", 1, keyboard_read_line},
+    {"Keyboard.readInt", 1, keyboard_read_int},
+    {"Sys.halt", 0, sys_halt},
+    {"Sys.error", 1, sys_error_native},
+    {"Sys.wait", 1, sys_wait},
+    {NULL, 0, NULL}};
+
+int find_native(char *name) {
+    for (int i = 0; native_table[i].name != NULL; i++) {
+        if (strcmp(native_table[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+NativeEntry *get_native(int idx) {
+    return &native_table[idx];
+}
@@ -0,0 +1,21 @@
+#ifndef NATIVES_H
+#define NATIVES_H
+
+#include <stdint.h>
+
+#include "interpreter.h"
+
+// a built-in implementation of an OS subroutine, args points at the first argument on the VM stack
+typedef int (*NativeFunction)(Interpreter *vm, int16_t *args);
+
+typedef struct {
+    char *name;
+    int args;
+    NativeFunction function;
+} NativeEntry;
+
+int find_native(char *name);
+NativeEntry *get_native(int idx);
+void reset_natives(Interpreter *vm);
+
+#endif
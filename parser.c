@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "compiler.h"
 #include "lexer.h"
@@ -36,6 +37,19 @@ int is_array = FALSE;
 int loop_label_idx = 0;
 int condition_label_idx = 0;
 
+// the last call written, a return right behind it is a tail call
+long last_call_start = -1;
+long last_call_end = -1;
+char last_call_name[LEXEME_LEN * 2];
+int last_call_args = 0;
+
+// library classes are only skimmed for their declarations, see skip_subroutine_body
+int skim_bodies = FALSE;
+
+// self tail calls jump back to a label right behind the function command
+long function_body_start = 0;
+int has_tail_call = FALSE;
+
 void new_fprintf(char *cmd, char *seg, int idx) {
     if (output_file == NULL) {
         printf("output file not exists");
@@ -62,12 +76,218 @@ void print_cmd(FILE *output_file, VmCommand cmd, Token token) {
     }
 }
 
+void print_bare_cmd(VmCommand cmd) {
+    fprintf(output_file, "%s\n", vm_commands[cmd]);
+}
+
+// expand a call to a small OS routine in place, its arguments are already on the stack, FALSE when it is not one
+int print_intrinsic(char *class, char *method) {
+    // the OS class being compiled keeps its own calls, it may implement one routine with another
+    if (get_compiler_options()->intrinsics == FALSE || strcmp(class, class_table->name) == 0) {
+        return FALSE;
+    }
+    if (strcmp(class, "Memory") == 0 && strcmp(method, "peek") == 0) {
+        new_fprintf(vm_commands[POP_CM], memory_segments[POINTER_SEG], 1);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[THAT_SEG], 0);
+    } else if (strcmp(class, "Memory") == 0 && strcmp(method, "poke") == 0) {
+        new_fprintf(vm_commands[POP_CM], memory_segments[TEMP_SEG], 0);
+        new_fprintf(vm_commands[POP_CM], memory_segments[POINTER_SEG], 1);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 0);
+        new_fprintf(vm_commands[POP_CM], memory_segments[THAT_SEG], 0);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[CONST_SEG], 0);
+    } else if (strcmp(class, "Math") == 0 && strcmp(method, "abs") == 0) {
+        // x + (-2x & (x < 0)), without branches so the block stays whole
+        new_fprintf(vm_commands[POP_CM], memory_segments[TEMP_SEG], 0);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 0);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 0);
+        print_bare_cmd(NEG_CM);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 0);
+        print_bare_cmd(SUB_CM);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 0);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[CONST_SEG], 0);
+        print_bare_cmd(LT_CM);
+        print_bare_cmd(AND_CM);
+        print_bare_cmd(ADD_CM);
+    } else if (strcmp(class, "Math") == 0 && (strcmp(method, "min") == 0 || strcmp(method, "max") == 0)) {
+        // b + ((a - b) & (a < b)) for min, a > b for max, temp 1 holds b until the last push
+        new_fprintf(vm_commands[POP_CM], memory_segments[TEMP_SEG], 1);
+        new_fprintf(vm_commands[POP_CM], memory_segments[TEMP_SEG], 0);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 1);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 0);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 1);
+        print_bare_cmd(SUB_CM);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 0);
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[TEMP_SEG], 1);
+        print_bare_cmd(strcmp(method, "min") == 0 ? LT_CM : GT_CM);
+        print_bare_cmd(AND_CM);
+        print_bare_cmd(ADD_CM);
+    } else if (strcmp(class, "Array") == 0 && strcmp(method, "new") == 0) {
+        fprintf(output_file, "%s Memory.alloc 1\n", vm_commands[CALL_CM]);
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
 void print_method_invoke(char *cmd, char *class, char *method, int idx) {
     if (output_file == NULL) {
         printf("output file not exists");
         exit(1);
     }
+    int is_call = strcmp(cmd, vm_commands[CALL_CM]) == 0;
+    if (is_call && print_intrinsic(class, method) == TRUE) {
+        return;
+    }
+    if (is_call) {
+        last_call_start = ftell(output_file);
+    }
     fprintf(output_file, "%s %s.%s %d\n", cmd, class, method, idx);
+    if (is_call) {
+        last_call_end = ftell(output_file);
+        snprintf(last_call_name, sizeof(last_call_name), "%s.%s", class, method);
+        last_call_args = idx;
+    }
+}
+
+// the return value is the result of calling the current subroutine with its own number of arguments
+int is_self_tail_call() {
+    char name[LEXEME_LEN * 2];
+    snprintf(name, sizeof(name), "%s.%s", class_table->name, method_table->name);
+    return last_call_end >= 0 && ftell(output_file) == last_call_end && strcmp(last_call_name, name) == 0 &&
+           last_call_args == method_table->symbol_kind_cnt[ARGS] - 1 + is_method;
+}
+
+// replace the call by storing the new arguments and jumping back to the function entry
+void print_tail_call() {
+    fseek(output_file, last_call_start, SEEK_SET);
+    for (int i = last_call_args - 1; i >= 0; i--) {
+        new_fprintf(vm_commands[POP_CM], memory_segments[ARGUMENT_SEG], i);
+    }
+    // locals start from zero again, as they would in a new frame
+    for (int i = 0; i < method_table->symbol_kind_cnt[VAR]; i++) {
+        new_fprintf(vm_commands[PUSH_CM], memory_segments[CONST_SEG], 0);
+        new_fprintf(vm_commands[POP_CM], memory_segments[LOCAL_SEG], i);
+    }
+    fprintf(output_file, "%s entry\n", vm_commands[GOTO_CM]);
+    fflush(output_file);
+    if (ftruncate(fileno(output_file), ftell(output_file)) != 0) {
+        printf("error when rewriting the compiled file\n");
+        fail_compile();
+    }
+    last_call_end = -1;
+    has_tail_call = TRUE;
+}
+
+// write the code generated between start and end once more at the end of the output
+void print_copy(long start, long end) {
+    fflush(output_file);
+    long size = end - start;
+    char *text = (char *)malloc(size + 1);
+
+    fseek(output_file, start, SEEK_SET);
+    size = fread(text, 1, size, output_file);
+    fseek(output_file, 0, SEEK_END);
+    fwrite(text, 1, size, output_file);
+    free(text);
+}
+
+// TRUE when the code generated since start leaves 0 or -1, i.e. it ends in a comparison, true / false, or
+// not / and / or of such values; only then may a test use "not; if-goto", which differs for any other value
+int is_boolean_code(long start) {
+    fflush(output_file);
+    long size = ftell(output_file) - start;
+    char *text = (char *)malloc(size + 1);
+    fseek(output_file, start, SEEK_SET);
+    size = fread(text, 1, size, output_file);
+    fseek(output_file, 0, SEEK_END);
+    text[size] = '\0';
+
+    // one flag per stack slot the code pushed, the expression leaves exactly one
+    int booleans[256];
+    int depth = 0;
+    int known = TRUE;
+    for (char *line = strtok(text, "\n"); line != NULL && known == TRUE; line = strtok(NULL, "\n")) {
+        char command[16] = "", segment[16] = "";
+        int index = 0;
+        sscanf(line, "%15s %15s %d", command, segment, &index);
+        if (strcmp(command, vm_commands[PUSH_CM]) == 0) {
+            known = depth < 256;
+            if (known == TRUE) {
+                booleans[depth] = strcmp(segment, memory_segments[CONST_SEG]) == 0 && index == 0;
+                depth += 1;
+            }
+        } else if (strcmp(command, vm_commands[POP_CM]) == 0) {
+            depth -= 1;
+        } else if (strcmp(command, vm_commands[CALL_CM]) == 0) {
+            depth -= index;
+            known = depth >= 0 && depth < 256;
+            if (known == TRUE) {
+                booleans[depth] = FALSE;
+                depth += 1;
+            }
+        } else if (strcmp(command, vm_commands[NOT_CM]) == 0 || strcmp(command, vm_commands[NEG_CM]) == 0) {
+            known = depth >= 1;
+            if (known == TRUE && strcmp(command, vm_commands[NEG_CM]) == 0) {
+                booleans[depth - 1] = FALSE;
+            }
+        } else if (strcmp(command, vm_commands[EQ_CM]) == 0 || strcmp(command, vm_commands[LT_CM]) == 0 ||
+                   strcmp(command, vm_commands[GT_CM]) == 0) {
+            known = depth >= 2;
+            if (known == TRUE) {
+                depth -= 1;
+                booleans[depth - 1] = TRUE;
+            }
+        } else if (strcmp(command, vm_commands[AND_CM]) == 0 || strcmp(command, vm_commands[OR_CM]) == 0) {
+            known = depth >= 2;
+            if (known == TRUE) {
+                depth -= 1;
+                booleans[depth - 1] = booleans[depth - 1] == TRUE && booleans[depth] == TRUE;
+            }
+        } else if (strcmp(command, vm_commands[ADD_CM]) == 0 || strcmp(command, vm_commands[SUB_CM]) == 0) {
+            known = depth >= 2;
+            if (known == TRUE) {
+                depth -= 1;
+                booleans[depth - 1] = FALSE;
+            }
+        } else {
+            // labels and jumps, expressions do not generate them
+            known = FALSE;
+        }
+        known = known == TRUE && depth >= 0;
+    }
+    free(text);
+    return known == TRUE && depth == 1 && booleans[0] == TRUE;
+}
+
+// write a label in front of the code generated since start
+void print_label_at(long start, char *label, int idx) {
+    fflush(output_file);
+    long size = ftell(output_file) - start;
+    char *text = (char *)malloc(size + 1);
+    fseek(output_file, start, SEEK_SET);
+    size = fread(text, 1, size, output_file);
+    fseek(output_file, start, SEEK_SET);
+    fprintf(output_file, "%s %s%d\n", vm_commands[LABEL_CM], label, idx);
+    fwrite(text, 1, size, output_file);
+    free(text);
+    // calls in the moved code are no longer where they were written
+    last_call_end = -1;
+}
+
+// insert the entry label once the function is complete and known to need it
+void print_entry_label() {
+    fflush(output_file);
+    long end = ftell(output_file);
+    long size = end - function_body_start;
+    char *body = (char *)malloc(size + 1);
+
+    fseek(output_file, function_body_start, SEEK_SET);
+    size = fread(body, 1, size, output_file);
+    fseek(output_file, function_body_start, SEEK_SET);
+    fprintf(output_file, "%s entry\n", vm_commands[LABEL_CM]);
+    fwrite(body, 1, size, output_file);
+    free(body);
+    has_tail_call = FALSE;
 }
 
 void reset() {
@@ -1093,6 +1313,7 @@ int validate_subroutine_statement(int in_codegen_phase) {
             is_lexer_error = TRUE;
             return TRUE;
         }
+        long condition_start = in_codegen_phase == TRUE ? ftell(output_file) : 0;
         int is_expression12 = token29.tp == ID || token29.tp == STRING || token29.tp == INT || (token29.tp == RESWORD && is_lexeme_acceptable(token29.lx, factor_keywords)) || (token29.tp == SYMBOL && is_lexeme_acceptable(token29.lx, factor_keywords));
         if (is_expression12 == TRUE) {
             int error_in_expression12 = validate_expression(in_codegen_phase);
@@ -1114,10 +1335,17 @@ int validate_subroutine_statement(int in_codegen_phase) {
             return TRUE;
         }
 
+        // a 0 / -1 condition lets the then branch follow the test with only a false condition jumping,
+        // any other value runs the then branch when it is not 0
         if (in_codegen_phase == TRUE) {
-            new_fprintf(vm_commands[IF_GOTO_CM], "", curr_condition_label_idx);
-            new_fprintf(vm_commands[GOTO_CM], "", curr_condition_label_idx);
-            new_fprintf(vm_commands[LABEL_CM], "", curr_condition_label_idx);
+            if (is_boolean_code(condition_start) == TRUE) {
+                fprintf(output_file, "%s\n", vm_commands[NOT_CM]);
+                fprintf(output_file, "%s IF_FALSE%d\n", vm_commands[IF_GOTO_CM], curr_condition_label_idx);
+            } else {
+                fprintf(output_file, "%s IF_TRUE%d\n", vm_commands[IF_GOTO_CM], curr_condition_label_idx);
+                fprintf(output_file, "%s IF_FALSE%d\n", vm_commands[GOTO_CM], curr_condition_label_idx);
+                fprintf(output_file, "%s IF_TRUE%d\n", vm_commands[LABEL_CM], curr_condition_label_idx);
+            }
         }
 
         // {
@@ -1168,8 +1396,8 @@ int validate_subroutine_statement(int in_codegen_phase) {
         }
         if (token31.tp == RESWORD && is_lexeme_acceptable(token31.lx, (char *[]){"else", NULL})) {
             if (in_codegen_phase == TRUE) {
-                fprintf(output_file, "%s %d\n", vm_commands[GOTO_CM], curr_condition_label_idx);
-                fprintf(output_file, "%s %d\n", vm_commands[LABEL_CM], curr_condition_label_idx);
+                fprintf(output_file, "%s IF_END%d\n", vm_commands[GOTO_CM], curr_condition_label_idx);
+                fprintf(output_file, "%s IF_FALSE%d\n", vm_commands[LABEL_CM], curr_condition_label_idx);
             }
 
             int else_keyword_exists = consume_terminal(RESWORD, (char *[]){"else", NULL});
@@ -1216,11 +1444,11 @@ int validate_subroutine_statement(int in_codegen_phase) {
             }
 
             if (in_codegen_phase == TRUE) {
-                fprintf(output_file, "%s %d\n", vm_commands[LABEL_CM], curr_condition_label_idx);
+                fprintf(output_file, "%s IF_END%d\n", vm_commands[LABEL_CM], curr_condition_label_idx);
             }
         } else {
             if (in_codegen_phase == TRUE) {
-                fprintf(output_file, "%s %d\n", vm_commands[LABEL_CM], curr_condition_label_idx);
+                fprintf(output_file, "%s IF_FALSE%d\n", vm_commands[LABEL_CM], curr_condition_label_idx);
             }
         }
         return FALSE;
@@ -1237,10 +1465,6 @@ int validate_subroutine_statement(int in_codegen_phase) {
             return TRUE;
         }
 
-        if (in_codegen_phase == TRUE) {
-            fprintf(output_file, "%s %d\n", vm_commands[LABEL_CM], curr_loop_label_idx);
-        }
-
         // "("
         int open_paren_exists3 = consume_terminal(SYMBOL, (char *[]){"(", NULL});
         if (is_lexer_error == TRUE) {
@@ -1259,6 +1483,7 @@ int validate_subroutine_statement(int in_codegen_phase) {
             return TRUE;
         }
 
+        long condition_start = in_codegen_phase == TRUE ? ftell(output_file) : 0;
         int is_expression13 = token33.tp == ID || token33.tp == STRING || token33.tp == INT || (token33.tp == RESWORD && is_lexeme_acceptable(token33.lx, factor_keywords)) || (token33.tp == SYMBOL && is_lexeme_acceptable(token33.lx, factor_keywords));
         if (is_expression13 == TRUE) {
             int error_in_expression13 = validate_expression(in_codegen_phase);
@@ -1280,9 +1505,19 @@ int validate_subroutine_statement(int in_codegen_phase) {
             return TRUE;
         }
 
+        // rotated loop: a 0 / -1 condition is tested once here and again at the bottom of the body, any other
+        // value keeps the test at the top, where "not; if-goto" continues the loop only on -1
+        long condition_end = in_codegen_phase == TRUE ? ftell(output_file) : 0;
+        int rotated = in_codegen_phase == TRUE && is_boolean_code(condition_start) == TRUE;
         if (in_codegen_phase == TRUE) {
+            if (rotated == FALSE) {
+                print_label_at(condition_start, "WHILE_EXP", curr_loop_label_idx);
+            }
             fprintf(output_file, "%s\n", vm_commands[NOT_CM]);
-            fprintf(output_file, "%s %d\n", vm_commands[IF_GOTO_CM], curr_loop_label_idx);
+            fprintf(output_file, "%s WHILE_END%d\n", vm_commands[IF_GOTO_CM], curr_loop_label_idx);
+            if (rotated == TRUE) {
+                fprintf(output_file, "%s WHILE_EXP%d\n", vm_commands[LABEL_CM], curr_loop_label_idx);
+            }
         }
 
         // "{"
@@ -1313,8 +1548,13 @@ int validate_subroutine_statement(int in_codegen_phase) {
         }
 
         if (in_codegen_phase == TRUE) {
-            fprintf(output_file, "%s %d\n", vm_commands[GOTO_CM], curr_loop_label_idx);
-            fprintf(output_file, "%s %d\n", vm_commands[LABEL_CM], curr_loop_label_idx);
+            if (rotated == TRUE) {
+                print_copy(condition_start, condition_end);
+                fprintf(output_file, "%s WHILE_EXP%d\n", vm_commands[IF_GOTO_CM], curr_loop_label_idx);
+            } else {
+                fprintf(output_file, "%s WHILE_EXP%d\n", vm_commands[GOTO_CM], curr_loop_label_idx);
+            }
+            fprintf(output_file, "%s WHILE_END%d\n", vm_commands[LABEL_CM], curr_loop_label_idx);
         }
 
         // "}"
@@ -1786,7 +2026,11 @@ int validate_subroutine_statement(int in_codegen_phase) {
         }
 
         if (in_codegen_phase == TRUE) {
-            fprintf(output_file, "%s\n", vm_commands[RETURN_CM]);
+            if (get_compiler_options()->tail_calls == TRUE && is_expression17 == TRUE && is_self_tail_call() == TRUE) {
+                print_tail_call();
+            } else {
+                fprintf(output_file, "%s\n", vm_commands[RETURN_CM]);
+            }
         }
 
         // ;
@@ -1848,6 +2092,37 @@ int validate_subroutine_body(int in_codegen_phase) {
     return FALSE;
 }
 
+// step over a subroutine body by matching braces, its statements are not checked and declare nothing outside it
+int skip_subroutine_body() {
+    int open_brace_exists = consume_terminal(SYMBOL, (char *[]){"{", NULL});
+    if (is_lexer_error) {
+        return TRUE;
+    } else if (open_brace_exists == FALSE) {
+        error_info.er = openBraceExpected;
+        return TRUE;
+    }
+
+    int depth = 1;
+    while (depth > 0) {
+        Token token = GetNextToken();
+        if (token.tp == ERR) {
+            error_info.er = lexerErr;
+            error_info.tk = token;
+            is_lexer_error = TRUE;
+            return TRUE;
+        } else if (token.tp == EOFile) {
+            error_info.er = closeBraceExpected;
+            error_info.tk = token;
+            return TRUE;
+        } else if (token.tp == SYMBOL && strcmp(token.lx, "{") == 0) {
+            depth += 1;
+        } else if (token.tp == SYMBOL && strcmp(token.lx, "}") == 0) {
+            depth -= 1;
+        }
+    }
+    return FALSE;
+}
+
 int validate_subroutine_declaration(int in_codegen_phase) {
     Token temp_subroutine_declare = PeekNextToken();
     // check "function" or "method" or "constructor"
@@ -1926,6 +2201,8 @@ int validate_subroutine_declaration(int in_codegen_phase) {
         method_table = r->child_table;
 
         print_method_invoke(vm_commands[FUNCTION_CM], class_table->name, method_table->name, method_table->symbol_kind_cnt[VAR]);
+        function_body_start = ftell(output_file);
+        has_tail_call = FALSE;
 
         if (subroutine_declaration_kind == CONSTRUCTOR) {
             new_fprintf(vm_commands[PUSH_CM], memory_segments[CONST_SEG], class_table->symbol_kind_cnt[FIELD]);
@@ -1979,11 +2256,15 @@ int validate_subroutine_declaration(int in_codegen_phase) {
     }
 
     // subroutine body
-    int error_exists_subroutine_body = validate_subroutine_body(in_codegen_phase);
+    int error_exists_subroutine_body = skim_bodies == TRUE ? skip_subroutine_body() : validate_subroutine_body(in_codegen_phase);
     if (error_exists_subroutine_body == TRUE) {
         return TRUE;
     }
 
+    if (in_codegen_phase == TRUE && has_tail_call == TRUE) {
+        print_entry_label();
+    }
+
     // reset
     method_table = NULL;
     is_method = 0;
@@ -2087,10 +2368,16 @@ int InitParser(char *file_name) {
     int in_codegen_phase = is_codegen_phase();
     if (in_codegen_phase == TRUE) {
         output_file = get_output_file();
+        if (output_file == NULL) {
+            return 0;
+        }
     }
 
     condition_label_idx = 0;
     loop_label_idx = 0;
+    last_call_start = -1;
+    last_call_end = -1;
+    has_tail_call = FALSE;
     return InitLexer(file_name);
 }
 
@@ -2123,6 +2410,11 @@ ParserInfo Parse() {
     return parser_info;
 }
 
+// TRUE while parsing library classes, which only need their declarations in the program table
+void SetSkimParsing(int skim) {
+    skim_bodies = skim;
+}
+
 int StopParser() {
     reset();
 
@@ -0,0 +1,1198 @@
+#include "passes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// OS functions without side effects that are defined for every argument, Math.divide and Math.sqrt can fail
+char *pure_functions[] = {"Math.multiply", "Math.abs", "Math.min", "Math.max", NULL};
+
+int is_pure_call(VmInstruction *instruction) {
+    for (int i = 0; pure_functions[i] != NULL; i++) {
+        if (strcmp(instruction->name, pure_functions[i]) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int same_instruction(VmInstruction *a, VmInstruction *b) {
+    if (a->cmd != b->cmd) {
+        return FALSE;
+    }
+    if (a->cmd == PUSH_CM || a->cmd == POP_CM) {
+        return a->seg == b->seg && a->idx == b->idx;
+    }
+    if (a->cmd == CALL_CM) {
+        return a->idx == b->idx && strcmp(a->name, b->name) == 0;
+    }
+    return a->cmd != LABEL_CM && a->cmd != GOTO_CM && a->cmd != IF_GOTO_CM;
+}
+
+VmInstruction local_access(VmCommand cmd, int idx) {
+    VmInstruction instruction;
+    instruction.cmd = cmd;
+    instruction.seg = LOCAL_SEG;
+    instruction.idx = idx;
+    instruction.name[0] = '\0';
+    return instruction;
+}
+
+// marks the blocks of the natural loop of header, i.e. every block that reaches a back edge without passing the header
+int find_natural_loop(IrFunction *function, int header, char *in_loop) {
+    int *worklist = (int *)malloc(sizeof(int) * (function->size + 1));
+    int worklist_size = 0;
+    memset(in_loop, FALSE, function->size);
+    in_loop[header] = TRUE;
+
+    int found = FALSE;
+    BasicBlock *block = &function->blocks[header];
+    for (int k = 0; k < block->predecessor_count; k++) {
+        int latch = block->predecessors[k];
+        if (dominates(function, header, latch) == FALSE) {
+            continue;
+        }
+        found = TRUE;
+        if (in_loop[latch] == FALSE) {
+            in_loop[latch] = TRUE;
+            worklist[worklist_size] = latch;
+            worklist_size += 1;
+        }
+    }
+
+    while (worklist_size > 0) {
+        worklist_size -= 1;
+        BasicBlock *member = &function->blocks[worklist[worklist_size]];
+        for (int k = 0; k < member->predecessor_count; k++) {
+            int predecessor = member->predecessors[k];
+            if (in_loop[predecessor] == FALSE && function->blocks[predecessor].order >= 0) {
+                in_loop[predecessor] = TRUE;
+                worklist[worklist_size] = predecessor;
+                worklist_size += 1;
+            }
+        }
+    }
+    free(worklist);
+    return found;
+}
+
+// what the loop body may change behind an expression's back
+typedef struct {
+    int calls;          // any call, callees share the temp segment
+    int impure_calls;   // calls that may write memory or statics
+    int writes_memory;  // pop this / pop that, this and that may point to the same object
+    int sets_this;      // pop pointer 0
+} LoopEffects;
+
+void collect_loop_effects(IrFunction *function, char *in_loop, LoopEffects *effects) {
+    effects->calls = FALSE;
+    effects->impure_calls = FALSE;
+    effects->writes_memory = FALSE;
+    effects->sets_this = FALSE;
+    for (int i = 0; i < function->size; i++) {
+        if (in_loop[i] == FALSE) {
+            continue;
+        }
+        for (int j = 0; j < function->blocks[i].size; j++) {
+            VmInstruction *instruction = &function->blocks[i].code[j];
+            if (instruction->cmd == CALL_CM) {
+                effects->calls = TRUE;
+                if (is_pure_call(instruction) == FALSE) {
+                    effects->impure_calls = TRUE;
+                }
+            } else if (instruction->cmd == POP_CM && (instruction->seg == THIS_SEG || instruction->seg == THAT_SEG)) {
+                effects->writes_memory = TRUE;
+            } else if (instruction->cmd == POP_CM && instruction->seg == POINTER_SEG && instruction->idx == 0) {
+                effects->sets_this = TRUE;
+            }
+        }
+    }
+}
+
+int loop_writes(IrFunction *function, char *in_loop, MemorySegment seg, int idx) {
+    for (int i = 0; i < function->size; i++) {
+        if (in_loop[i] == FALSE) {
+            continue;
+        }
+        for (int j = 0; j < function->blocks[i].size; j++) {
+            VmInstruction *instruction = &function->blocks[i].code[j];
+            if (instruction->cmd == POP_CM && instruction->seg == seg && instruction->idx == idx) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+int is_invariant_push(IrFunction *function, char *in_loop, LoopEffects *effects, VmInstruction *instruction) {
+    switch (instruction->seg) {
+        case CONST_SEG:
+            return TRUE;
+        case LOCAL_SEG:
+        case ARGUMENT_SEG:
+            return loop_writes(function, in_loop, instruction->seg, instruction->idx) == FALSE;
+        case STATIC_SEG:
+            return effects->impure_calls == FALSE && loop_writes(function, in_loop, STATIC_SEG, instruction->idx) == FALSE;
+        case TEMP_SEG:
+            return effects->calls == FALSE && loop_writes(function, in_loop, TEMP_SEG, instruction->idx) == FALSE;
+        case THIS_SEG:
+            return effects->sets_this == FALSE && effects->writes_memory == FALSE && effects->impure_calls == FALSE;
+        case POINTER_SEG:
+            return instruction->idx == 0 && effects->sets_this == FALSE;
+        default:
+            // that is only followed through the pop pointer 1 / push that pattern of array reads
+            return FALSE;
+    }
+}
+
+// a value on the block's stack, built by the instructions [start, end)
+typedef struct {
+    int start;
+    int end;
+    int invariant;
+} LoopExpression;
+
+typedef struct {
+    int block;
+    int start;
+    int end;
+} HoistRange;
+
+void add_hoist_range(HoistRange **ranges, int *count, int *capacity, int block, LoopExpression *expression) {
+    // a single push is as cheap as reading it back from a local
+    if (expression->invariant == FALSE || expression->end - expression->start < 2) {
+        return;
+    }
+    if (*count == *capacity) {
+        *capacity *= 2;
+        *ranges = (HoistRange *)realloc(*ranges, sizeof(HoistRange) * (*capacity));
+    }
+    (*ranges)[*count].block = block;
+    (*ranges)[*count].start = expression->start;
+    (*ranges)[*count].end = expression->end;
+    *count += 1;
+}
+
+// the largest invariant expressions of one block, in no particular order
+void find_block_invariants(IrFunction *function, char *in_loop, LoopEffects *effects, int b, HoistRange **ranges, int *count, int *capacity) {
+    BasicBlock *block = &function->blocks[b];
+    LoopExpression *stack = (LoopExpression *)malloc(sizeof(LoopExpression) * (block->size + 1));
+    int top = 0;
+
+    for (int j = 0; j < block->size; j++) {
+        VmInstruction *instruction = &block->code[j];
+        LoopExpression result = {j, j + 1, FALSE};
+
+        if (instruction->cmd == PUSH_CM) {
+            result.invariant = is_invariant_push(function, in_loop, effects, instruction);
+        } else if (instruction->cmd == POP_CM && instruction->seg == POINTER_SEG && instruction->idx == 1 &&
+                   j + 1 < block->size && block->code[j + 1].cmd == PUSH_CM && block->code[j + 1].seg == THAT_SEG) {
+            // an array read, invariant when its address is and nothing in the loop stores to memory
+            top -= 1;
+            result.start = stack[top].start;
+            result.end = j + 2;
+            result.invariant = stack[top].invariant == TRUE && effects->writes_memory == FALSE && effects->impure_calls == FALSE;
+            if (result.invariant == FALSE) {
+                add_hoist_range(ranges, count, capacity, b, &stack[top]);
+            }
+            stack[top] = result;
+            top += 1;
+            j += 1;
+            continue;
+        } else {
+            int pops = stack_pops(instruction);
+            int invariant = instruction->cmd != POP_CM && instruction->cmd != IF_GOTO_CM && instruction->cmd != RETURN_CM &&
+                            (instruction->cmd != CALL_CM || is_pure_call(instruction) == TRUE);
+            for (int k = top - pops; k < top; k++) {
+                if (stack[k].invariant == FALSE) {
+                    invariant = FALSE;
+                }
+            }
+            if (pops > 0) {
+                result.start = stack[top - pops].start;
+            }
+            if (invariant == FALSE) {
+                for (int k = top - pops; k < top; k++) {
+                    add_hoist_range(ranges, count, capacity, b, &stack[k]);
+                }
+            }
+            top -= pops;
+            result.invariant = invariant;
+        }
+
+        if (stack_pushes(instruction) > 0) {
+            stack[top] = result;
+            top += 1;
+        }
+    }
+    free(stack);
+}
+
+// a block in front of the header that every entry into the loop passes, returns its index
+int add_preheader(IrFunction *function, int header, char *in_loop) {
+    int preheader = insert_block(function, header);
+    header += 1;
+    for (int i = function->size - 1; i > preheader; i--) {
+        in_loop[i] = in_loop[i - 1];
+    }
+    in_loop[preheader] = FALSE;
+
+    function->blocks[preheader].fallthrough = header;
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        if (i == preheader || in_loop[i] == TRUE) {
+            continue;
+        }
+        if (block->fallthrough == header) {
+            block->fallthrough = preheader;
+        }
+        if (block->target == header) {
+            new_block_label(function, preheader);
+            block->target = preheader;
+            strcpy(block->code[block->size - 1].name, function->blocks[preheader].label);
+        }
+    }
+    return preheader;
+}
+
+int compare_hoist_ranges(const void *a, const void *b) {
+    const HoistRange *x = (const HoistRange *)a;
+    const HoistRange *y = (const HoistRange *)b;
+    if (x->block != y->block) {
+        return x->block - y->block;
+    }
+    return x->start - y->start;
+}
+
+// hoists the invariants of the loop headed by header, returns the instructions taken out of the loop
+int hoist_loop(IrFunction *function, int header) {
+    char *in_loop = (char *)malloc(function->size + 1);
+    if (find_natural_loop(function, header, in_loop) == FALSE) {
+        free(in_loop);
+        return 0;
+    }
+
+    LoopEffects effects;
+    collect_loop_effects(function, in_loop, &effects);
+    int capacity = 8;
+    int count = 0;
+    HoistRange *ranges = (HoistRange *)malloc(sizeof(HoistRange) * capacity);
+    for (int i = 0; i < function->size; i++) {
+        if (in_loop[i] == TRUE) {
+            find_block_invariants(function, in_loop, &effects, i, &ranges, &count, &capacity);
+        }
+    }
+    if (count == 0) {
+        free(ranges);
+        free(in_loop);
+        return 0;
+    }
+    qsort(ranges, count, sizeof(HoistRange), compare_hoist_ranges);
+
+    int preheader = add_preheader(function, header, in_loop);
+    for (int r = 0; r < count; r++) {
+        if (ranges[r].block >= preheader) {
+            ranges[r].block += 1;
+        }
+    }
+
+    // each distinct expression gets a new local, evaluated once per entry into the loop
+    int *locals = (int *)malloc(sizeof(int) * (count + 1));
+    int moved = 0;
+    for (int r = 0; r < count; r++) {
+        BasicBlock *block = &function->blocks[ranges[r].block];
+        int length = ranges[r].end - ranges[r].start;
+        locals[r] = -1;
+        for (int q = 0; q < r && locals[r] < 0; q++) {
+            BasicBlock *other = &function->blocks[ranges[q].block];
+            if (ranges[q].end - ranges[q].start != length) {
+                continue;
+            }
+            int same = TRUE;
+            for (int k = 0; k < length && same == TRUE; k++) {
+                same = same_instruction(&block->code[ranges[r].start + k], &other->code[ranges[q].start + k]);
+            }
+            if (same == TRUE) {
+                locals[r] = locals[q];
+            }
+        }
+        if (locals[r] < 0) {
+            locals[r] = function->header.idx;
+            function->header.idx += 1;
+            for (int k = ranges[r].start; k < ranges[r].end; k++) {
+                add_block_instruction(&function->blocks[preheader], &block->code[k]);
+            }
+            VmInstruction store = local_access(POP_CM, locals[r]);
+            add_block_instruction(&function->blocks[preheader], &store);
+        }
+        moved += length - 1;
+    }
+
+    // rewrite the loop blocks, ranges are sorted and never overlap
+    int r = 0;
+    for (int i = 0; i < function->size && r < count; i++) {
+        if (ranges[r].block != i) {
+            continue;
+        }
+        BasicBlock *block = &function->blocks[i];
+        VmInstruction *code = block->code;
+        int size = block->size;
+        block->code = (VmInstruction *)malloc(sizeof(VmInstruction) * block->capacity);
+        block->size = 0;
+        for (int j = 0; j < size; j++) {
+            if (r < count && ranges[r].block == i && ranges[r].start == j) {
+                VmInstruction load = local_access(PUSH_CM, locals[r]);
+                add_block_instruction(block, &load);
+                j = ranges[r].end - 1;
+                r += 1;
+                continue;
+            }
+            add_block_instruction(block, &code[j]);
+        }
+        free(code);
+    }
+
+    free(locals);
+    free(ranges);
+    free(in_loop);
+    update_cfg(function);
+    return moved;
+}
+
+int compare_loop_headers(const void *a, const void *b) {
+    return ((const int *)b)[1] - ((const int *)a)[1];
+}
+
+int hoist_loop_invariants(IrFunction *function) {
+    if (function->balanced == FALSE) {
+        return 0;
+    }
+
+    // headers are targets of a jump from a block they dominate, inner loops come later in reverse postorder
+    char(*headers)[VM_NAME_LEN] = malloc(sizeof(*headers) * (function->size + 1));
+    int(*orders)[2] = malloc(sizeof(*orders) * (function->size + 1));
+    int count = 0;
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        if (block->target >= 0 && dominates(function, block->target, i) == TRUE) {
+            int duplicate = FALSE;
+            for (int k = 0; k < count; k++) {
+                if (orders[k][0] == block->target) {
+                    duplicate = TRUE;
+                }
+            }
+            if (duplicate == FALSE) {
+                orders[count][0] = block->target;
+                orders[count][1] = function->blocks[block->target].order;
+                count += 1;
+            }
+        }
+    }
+    qsort(orders, count, sizeof(*orders), compare_loop_headers);
+    for (int k = 0; k < count; k++) {
+        strcpy(headers[k], function->blocks[orders[k][0]].label);
+    }
+
+    int moved = 0;
+    for (int k = 0; k < count; k++) {
+        int header = find_block_label(function, headers[k]);
+        if (header >= 0) {
+            moved += hoist_loop(function, header);
+        }
+    }
+    free(headers);
+    free(orders);
+    return moved;
+}
+
+// variables whose liveness is tracked: the frame's locals and arguments, the temps and both pointers
+typedef struct {
+    int locals;
+    int arguments;
+    int count;
+} LiveVariables;
+
+int live_variable(LiveVariables *variables, MemorySegment seg, int idx) {
+    switch (seg) {
+        case LOCAL_SEG:
+            return idx;
+        case ARGUMENT_SEG:
+            return variables->locals + idx;
+        case TEMP_SEG:
+            return variables->locals + variables->arguments + idx;
+        case POINTER_SEG:
+            return variables->locals + variables->arguments + 8 + idx;
+        default:
+            return -1;
+    }
+}
+
+// the variable an instruction reads, -1 for none, calls are handled by the caller
+int used_variable(LiveVariables *variables, VmInstruction *instruction) {
+    if (instruction->cmd == PUSH_CM) {
+        if (instruction->seg == THIS_SEG || instruction->seg == THAT_SEG) {
+            return live_variable(variables, POINTER_SEG, instruction->seg == THIS_SEG ? 0 : 1);
+        }
+        return live_variable(variables, instruction->seg, instruction->idx);
+    }
+    if (instruction->cmd == POP_CM && (instruction->seg == THIS_SEG || instruction->seg == THAT_SEG)) {
+        return live_variable(variables, POINTER_SEG, instruction->seg == THIS_SEG ? 0 : 1);
+    }
+    return -1;
+}
+
+int defined_variable(LiveVariables *variables, VmInstruction *instruction) {
+    if (instruction->cmd == POP_CM) {
+        return live_variable(variables, instruction->seg, instruction->idx);
+    }
+    return -1;
+}
+
+// updates live from the variables live after the instruction to those live before it
+void transfer_liveness(LiveVariables *variables, VmInstruction *instruction, char *live) {
+    int defined = defined_variable(variables, instruction);
+    if (defined >= 0) {
+        live[defined] = FALSE;
+    }
+    int used = used_variable(variables, instruction);
+    if (used >= 0) {
+        live[used] = TRUE;
+    }
+    if (instruction->cmd == CALL_CM) {
+        // a callee starts out with the caller's this and that
+        live[live_variable(variables, POINTER_SEG, 0)] = TRUE;
+        live[live_variable(variables, POINTER_SEG, 1)] = TRUE;
+    } else if (instruction->cmd == RETURN_CM) {
+        memset(live, FALSE, variables->count);
+    }
+}
+
+void count_frame_variables(IrFunction *function, LiveVariables *variables) {
+    variables->locals = function->header.idx;
+    variables->arguments = 0;
+    for (int i = 0; i < function->size; i++) {
+        for (int j = 0; j < function->blocks[i].size; j++) {
+            VmInstruction *instruction = &function->blocks[i].code[j];
+            if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == ARGUMENT_SEG &&
+                instruction->idx + 1 > variables->arguments) {
+                variables->arguments = instruction->idx + 1;
+            }
+            if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == LOCAL_SEG &&
+                instruction->idx + 1 > variables->locals) {
+                variables->locals = instruction->idx + 1;
+            }
+        }
+    }
+    variables->count = variables->locals + variables->arguments + 8 + 2;
+}
+
+// removes stores nobody reads, together with the value they store when computing it has no effect
+int remove_block_dead_stores(IrFunction *function, LiveVariables *variables, int b, char *live) {
+    BasicBlock *block = &function->blocks[b];
+    int *starts = (int *)malloc(sizeof(int) * (block->size + 1));
+    int *stack = (int *)malloc(sizeof(int) * (block->size + 1));
+    char *removed = (char *)calloc(block->size + 1, sizeof(char));
+    int top = 0;
+
+    // where the value each pop takes off the stack started to be computed
+    for (int j = 0; j < block->size; j++) {
+        VmInstruction *instruction = &block->code[j];
+        int start = j;
+        int pops = stack_pops(instruction);
+        if (pops > 0) {
+            start = stack[top - pops];
+        }
+        starts[j] = start;
+        top -= pops;
+        if (stack_pushes(instruction) > 0) {
+            stack[top] = start;
+            top += 1;
+        }
+    }
+
+    int count = 0;
+    for (int j = block->size - 1; j >= 0; j--) {
+        if (removed[j] == TRUE) {
+            continue;
+        }
+        VmInstruction *instruction = &block->code[j];
+        int defined = defined_variable(variables, instruction);
+        if (defined >= 0 && live[defined] == FALSE) {
+            int pure = TRUE;
+            for (int k = starts[j]; k < j; k++) {
+                if ((block->code[k].cmd == CALL_CM && is_pure_call(&block->code[k]) == FALSE) || block->code[k].cmd == POP_CM) {
+                    pure = FALSE;
+                }
+            }
+            // a value with side effects still has to be computed, and popping it is the only way to drop it
+            if (pure == TRUE) {
+                for (int k = starts[j]; k <= j; k++) {
+                    removed[k] = TRUE;
+                    count += 1;
+                }
+                continue;
+            }
+        }
+        transfer_liveness(variables, instruction, live);
+    }
+
+    if (count > 0) {
+        int size = 0;
+        for (int j = 0; j < block->size; j++) {
+            if (removed[j] == FALSE) {
+                block->code[size] = block->code[j];
+                size += 1;
+            }
+        }
+        block->size = size;
+    }
+    free(starts);
+    free(stack);
+    free(removed);
+    return count;
+}
+
+int remove_dead_stores(IrFunction *function) {
+    if (function->balanced == FALSE) {
+        return 0;
+    }
+
+    LiveVariables variables;
+    count_frame_variables(function, &variables);
+
+    // backward dataflow, live_in[b] holds the variables read before being written from the top of b
+    char *live_in = (char *)calloc(function->size * variables.count + 1, sizeof(char));
+    char *live = (char *)malloc(variables.count + 1);
+    int changed = TRUE;
+    while (changed == TRUE) {
+        changed = FALSE;
+        for (int i = function->size - 1; i >= 0; i--) {
+            BasicBlock *block = &function->blocks[i];
+            memset(live, FALSE, variables.count);
+            int successors[2] = {block->fallthrough, block->target};
+            for (int k = 0; k < 2; k++) {
+                for (int v = 0; successors[k] >= 0 && v < variables.count; v++) {
+                    live[v] |= live_in[successors[k] * variables.count + v];
+                }
+            }
+            for (int j = block->size - 1; j >= 0; j--) {
+                transfer_liveness(&variables, &block->code[j], live);
+            }
+            if (memcmp(live, &live_in[i * variables.count], variables.count) != 0) {
+                memcpy(&live_in[i * variables.count], live, variables.count);
+                changed = TRUE;
+            }
+        }
+    }
+
+    int removed = 0;
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        memset(live, FALSE, variables.count);
+        int successors[2] = {block->fallthrough, block->target};
+        for (int k = 0; k < 2; k++) {
+            for (int v = 0; successors[k] >= 0 && v < variables.count; v++) {
+                live[v] |= live_in[successors[k] * variables.count + v];
+            }
+        }
+        removed += remove_block_dead_stores(function, &variables, i, live);
+    }
+    free(live_in);
+    free(live);
+    if (removed > 0) {
+        update_cfg(function);
+    }
+    return removed;
+}
+
+// what a value number stands for, leaves carry the version of what they read
+typedef struct {
+    int op;  // VmCommand of the instruction computing it
+    int a;
+    int b;
+    int c;
+    int d;
+    char *name;  // pure calls only
+} ValueKey;
+
+typedef struct {
+    ValueKey *keys;
+    int size;
+    int capacity;
+} ValueTable;
+
+// the number of key, fresh when it was not seen before, unique values pass a NULL key
+int value_number(ValueTable *table, ValueKey *key) {
+    for (int i = 0; key != NULL && i < table->size; i++) {
+        ValueKey *other = &table->keys[i];
+        if (other->op == key->op && other->a == key->a && other->b == key->b && other->c == key->c && other->d == key->d &&
+            (other->name == NULL) == (key->name == NULL) && (key->name == NULL || strcmp(other->name, key->name) == 0)) {
+            return i;
+        }
+    }
+    if (table->size == table->capacity) {
+        table->capacity *= 2;
+        table->keys = (ValueKey *)realloc(table->keys, sizeof(ValueKey) * table->capacity);
+    }
+    ValueKey unique = {-1, table->size, 0, 0, 0, NULL};
+    table->keys[table->size] = key != NULL ? *key : unique;
+    table->size += 1;
+    return table->size - 1;
+}
+
+// an expression tree of the block, instructions [start, end) leave value on the stack
+typedef struct {
+    int start;
+    int end;
+    int value;
+    int calls;
+    int holder;  // variable known to hold the value before start, -1 for none
+} ValueNode;
+
+int is_commutative(VmCommand cmd) {
+    return cmd == ADD_CM || cmd == AND_CM || cmd == OR_CM || cmd == EQ_CM;
+}
+
+// a call inside a tree clears the temps, so a variable holding its value at the end held it before the tree too
+int find_value_holder(LiveVariables *variables, int *holds, int value) {
+    for (int v = 0; v < variables->locals + variables->arguments + 8; v++) {
+        if (holds[v] == value) {
+            return v;
+        }
+    }
+    return -1;
+}
+
+// numbers the expression trees of a block, returns how many were found
+int number_block_values(BasicBlock *block, LiveVariables *variables, ValueNode *nodes) {
+    ValueTable table;
+    table.size = 0;
+    table.capacity = 64;
+    table.keys = (ValueKey *)malloc(sizeof(ValueKey) * table.capacity);
+
+    int *holds = (int *)malloc(sizeof(int) * variables->count);     // value number a variable holds, -1 unknown
+    int *versions = (int *)calloc(variables->count, sizeof(int));  // bumped whenever a variable changes unseen
+    for (int v = 0; v < variables->count; v++) {
+        holds[v] = -1;
+    }
+    int memory = 0;   // bumped by every store to this / that and every call that may store
+    int statics = 0;  // bumped by every pop static and every call that may change one
+
+    int *stack = (int *)malloc(sizeof(int) * (block->size + 1));
+    int top = 0;
+    int count = 0;
+    for (int j = 0; j < block->size; j++) {
+        VmInstruction *instruction = &block->code[j];
+        ValueKey key = {instruction->cmd, 0, 0, 0, 0, NULL};
+        ValueNode node = {j, j + 1, -1, FALSE, -1};
+        int unique = FALSE;
+
+        if (instruction->cmd == PUSH_CM) {
+            int variable = live_variable(variables, instruction->seg, instruction->idx);
+            key.a = instruction->seg;
+            key.b = instruction->idx;
+            if (instruction->seg == THIS_SEG || instruction->seg == THAT_SEG) {
+                int pointer = live_variable(variables, POINTER_SEG, instruction->seg == THIS_SEG ? 0 : 1);
+                key.c = holds[pointer] >= 0 ? holds[pointer] : -2 - versions[pointer];
+                key.d = memory;
+            } else if (instruction->seg == STATIC_SEG) {
+                key.c = statics;
+            } else if (variable >= 0 && holds[variable] >= 0) {
+                node.value = holds[variable];
+            } else if (variable >= 0) {
+                key.c = versions[variable];
+            }
+        } else if (instruction->cmd == POP_CM) {
+            top -= 1;
+            int variable = live_variable(variables, instruction->seg, instruction->idx);
+            if (variable >= 0) {
+                holds[variable] = nodes[stack[top]].value;
+                versions[variable] += 1;
+            } else if (instruction->seg == STATIC_SEG) {
+                statics += 1;
+            } else if (instruction->seg == THIS_SEG || instruction->seg == THAT_SEG) {
+                memory += 1;
+            }
+
+            // pop pointer 1 / push that k reads an element, the read is one tree with its address
+            if (instruction->seg == POINTER_SEG && instruction->idx == 1 && j + 1 < block->size &&
+                block->code[j + 1].cmd == PUSH_CM && block->code[j + 1].seg == THAT_SEG) {
+                ValueNode *address = &nodes[stack[top]];
+                ValueKey load = {PUSH_CM, THAT_SEG, block->code[j + 1].idx, address->value, memory, NULL};
+                node.start = address->start;
+                node.end = j + 2;
+                node.value = value_number(&table, &load);
+                node.calls = address->calls;
+                node.holder = find_value_holder(variables, holds, node.value);
+                nodes[count] = node;
+                stack[top] = count;
+                top += 1;
+                count += 1;
+                j += 1;
+            }
+            continue;
+        } else if (instruction->cmd == CALL_CM) {
+            int args = instruction->idx;
+            int pure = is_pure_call(instruction) == TRUE && args <= 2;
+            key.a = args > 0 ? nodes[stack[top - args]].value : -1;
+            key.b = args > 1 ? nodes[stack[top - args + 1]].value : -1;
+            key.c = args;
+            key.name = instruction->name;
+            unique = pure == FALSE;
+            node.calls = TRUE;
+            if (args > 0) {
+                node.start = nodes[stack[top - args]].start;
+            }
+            for (int k = top - args; k < top; k++) {
+                node.calls |= nodes[stack[k]].calls;
+            }
+            top -= args;
+
+            // callees share the temps and may change statics and memory
+            for (int v = variables->locals + variables->arguments; v < variables->count; v++) {
+                holds[v] = -1;
+                versions[v] += 1;
+            }
+            if (pure == FALSE) {
+                memory += 1;
+                statics += 1;
+            }
+        } else if (instruction->cmd == NEG_CM || instruction->cmd == NOT_CM) {
+            key.a = nodes[stack[top - 1]].value;
+            node.start = nodes[stack[top - 1]].start;
+            node.calls = nodes[stack[top - 1]].calls;
+            top -= 1;
+        } else if (stack_pops(instruction) == 2 && stack_pushes(instruction) == 1) {
+            ValueNode *left = &nodes[stack[top - 2]];
+            ValueNode *right = &nodes[stack[top - 1]];
+            key.a = left->value;
+            key.b = right->value;
+            if (is_commutative(instruction->cmd) == TRUE && key.a > key.b) {
+                key.a = right->value;
+                key.b = left->value;
+            }
+            node.start = left->start;
+            node.calls = left->calls || right->calls;
+            top -= 2;
+        } else {
+            top -= stack_pops(instruction);
+            continue;
+        }
+
+        if (node.value < 0) {
+            node.value = value_number(&table, unique == TRUE ? NULL : &key);
+        }
+        node.holder = find_value_holder(variables, holds, node.value);
+        nodes[count] = node;
+        stack[top] = count;
+        top += 1;
+        count += 1;
+    }
+
+    free(stack);
+    free(holds);
+    free(versions);
+    free(table.keys);
+    return count;
+}
+
+VmInstruction variable_access(LiveVariables *variables, VmCommand cmd, int variable) {
+    VmInstruction instruction = local_access(cmd, variable);
+    if (variable >= variables->locals + variables->arguments) {
+        instruction.seg = TEMP_SEG;
+        instruction.idx = variable - variables->locals - variables->arguments;
+    } else if (variable >= variables->locals) {
+        instruction.seg = ARGUMENT_SEG;
+        instruction.idx = variable - variables->locals;
+    }
+    return instruction;
+}
+
+// replaces the instructions [start, end) of a block with the given ones
+void splice_block(BasicBlock *block, int start, int end, VmInstruction *replacement, int count) {
+    int size = block->size - (end - start) + count;
+    while (block->capacity < size) {
+        block->capacity *= 2;
+        block->code = (VmInstruction *)realloc(block->code, sizeof(VmInstruction) * block->capacity);
+    }
+    memmove(&block->code[start + count], &block->code[end], sizeof(VmInstruction) * (block->size - end));
+    memcpy(&block->code[start], replacement, sizeof(VmInstruction) * count);
+    block->size = size;
+}
+
+int free_temp_slot(IrFunction *function) {
+    char used[8] = {TRUE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE};  // temp 0 is the code generator's scratch slot
+    for (int i = 0; i < function->size; i++) {
+        for (int j = 0; j < function->blocks[i].size; j++) {
+            VmInstruction *instruction = &function->blocks[i].code[j];
+            if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == TEMP_SEG &&
+                instruction->idx >= 0 && instruction->idx < 8) {
+                used[instruction->idx] = TRUE;
+            }
+        }
+    }
+    for (int t = 1; t < 8; t++) {
+        if (used[t] == FALSE) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+// reuses one repeated tree of the block, the largest one first, returns FALSE when there is none
+int reuse_block_value(IrFunction *function, LiveVariables *variables, int b, int *saved) {
+    BasicBlock *block = &function->blocks[b];
+    ValueNode *nodes = (ValueNode *)malloc(sizeof(ValueNode) * (block->size + 1));
+    int count = number_block_values(block, variables, nodes);
+
+    int best = -1;
+    int best_earlier = -1;
+    for (int n = 0; n < count; n++) {
+        ValueNode *node = &nodes[n];
+        int size = node->end - node->start;
+        if (size < 2 || (best >= 0 && size <= nodes[best].end - nodes[best].start)) {
+            continue;
+        }
+        if (node->holder >= 0) {
+            best = n;
+            best_earlier = -1;
+            continue;
+        }
+        // storing the first result and reading it back costs two instructions
+        for (int e = 0; e < n; e++) {
+            if (nodes[e].value == node->value && nodes[e].end <= node->start && nodes[e].end - nodes[e].start == size &&
+                (size > 3 || node->calls == TRUE)) {
+                best = n;
+                best_earlier = e;
+                break;
+            }
+        }
+    }
+    if (best < 0) {
+        free(nodes);
+        return FALSE;
+    }
+
+    ValueNode node = nodes[best];
+    *saved += node.end - node.start - 1;
+    int holder = node.holder;
+    if (holder < 0) {
+        // the slot has to last until the value's final use in the block
+        ValueNode earlier = nodes[best_earlier];
+        int last = node.start;
+        for (int n = best + 1; n < count; n++) {
+            if (nodes[n].value == node.value) {
+                last = nodes[n].start;
+            }
+        }
+        int calls = FALSE;
+        for (int j = earlier.end; j < last; j++) {
+            if (block->code[j].cmd == CALL_CM) {
+                calls = TRUE;
+            }
+        }
+        int temp = calls == FALSE ? free_temp_slot(function) : -1;
+        if (temp >= 0) {
+            holder = live_variable(variables, TEMP_SEG, temp);
+        } else {
+            // a new local survives calls, it is past the locals the liveness numbering knows about
+            VmInstruction slot = local_access(PUSH_CM, function->header.idx);
+            function->header.idx += 1;
+            VmInstruction load = slot;
+            splice_block(block, node.start, node.end, &load, 1);
+            VmInstruction store[2] = {slot, slot};
+            store[0].cmd = POP_CM;
+            splice_block(block, earlier.end, earlier.end, store, 2);
+            *saved -= 2;
+            free(nodes);
+            return TRUE;
+        }
+        VmInstruction store[2] = {variable_access(variables, POP_CM, holder), variable_access(variables, PUSH_CM, holder)};
+        VmInstruction load = store[1];
+        splice_block(block, node.start, node.end, &load, 1);
+        splice_block(block, earlier.end, earlier.end, store, 2);
+        *saved -= 2;
+    } else {
+        VmInstruction load = variable_access(variables, PUSH_CM, holder);
+        splice_block(block, node.start, node.end, &load, 1);
+    }
+    free(nodes);
+    return TRUE;
+}
+
+int number_values(IrFunction *function) {
+    if (function->balanced == FALSE) {
+        return 0;
+    }
+
+    int saved = 0;
+    for (int i = 0; i < function->size; i++) {
+        LiveVariables variables;
+        do {
+            count_frame_variables(function, &variables);
+        } while (reuse_block_value(function, &variables, i, &saved) == TRUE);
+    }
+    return saved;
+}
+
+// instructions after lowering, i.e. with the gotos of fall-through edges that are not adjacent
+int lowered_size(IrFunction *function) {
+    int size = count_ir_instructions(function);
+    for (int i = 0; i < function->size; i++) {
+        if (function->blocks[i].fallthrough >= 0 && function->blocks[i].fallthrough != i + 1) {
+            size += 1;
+        }
+    }
+    return size;
+}
+
+// block entry counts from the profile, blocks without a label are only entered from the block above
+void estimate_block_counts(IrFunction *function, long long *counts, long long *taken) {
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        long long count = 0;
+        if (i == 0) {
+            count = profile_function_count(function->header.name);
+        } else if (block->label[0] != '\0') {
+            count = profile_block_count(function->header.name, block->label);
+        } else if (function->blocks[i - 1].fallthrough == i) {
+            count = counts[i - 1] - taken[i - 1];
+        }
+        counts[i] = count > 0 ? count : 0;
+
+        long long executed = 0;
+        long long jumps = 0;
+        taken[i] = 0;
+        VmInstruction *last = block->size > 0 ? &block->code[block->size - 1] : NULL;
+        if (last != NULL && last->cmd == IF_GOTO_CM && profile_branch(function->header.name, last->name, &executed, &jumps) == TRUE &&
+            executed > 0) {
+            taken[i] = counts[i] * jumps / executed;
+        } else if (last != NULL && last->cmd == GOTO_CM) {
+            taken[i] = counts[i];
+        }
+    }
+}
+
+// weight of the edge from block to successor
+long long edge_count(IrFunction *function, long long *counts, long long *taken, int block, int successor) {
+    long long count = 0;
+    if (function->blocks[block].target == successor) {
+        count += taken[block];
+    }
+    if (function->blocks[block].fallthrough == successor) {
+        count += counts[block] - taken[block];
+    }
+    return count;
+}
+
+// TRUE when the instruction leaves 0 or -1, the only values for which not turns zero into non-zero and back
+int is_boolean_producer(VmInstruction *instruction) {
+    return instruction->cmd == EQ_CM || instruction->cmd == LT_CM || instruction->cmd == GT_CM;
+}
+
+// profile-guided block order: every block is followed by its hottest successor not placed yet
+int layout_blocks(IrFunction *function) {
+    if (has_profile() == FALSE || profile_function_count(function->header.name) <= 0) {
+        return 0;
+    }
+    int before = lowered_size(function);
+    long long *counts = (long long *)malloc(sizeof(long long) * (function->size + 1));
+    long long *taken = (long long *)malloc(sizeof(long long) * (function->size + 1));
+    estimate_block_counts(function, counts, taken);
+
+    // a goto is a fall-through edge that lowering puts back when its target does not end up below
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        if (block->size > 0 && block->code[block->size - 1].cmd == GOTO_CM) {
+            block->size -= 1;
+            block->fallthrough = block->target;
+            block->target = -1;
+            taken[i] = 0;
+        }
+    }
+
+    // a mostly taken not / if-goto over a comparison jumps to the other successor instead and loses the not;
+    // for any other value ~x and x are both non-zero, testing x = -1 would cost more than the jump saves
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        if (block->size < 3 || block->code[block->size - 1].cmd != IF_GOTO_CM || block->code[block->size - 2].cmd != NOT_CM ||
+            is_boolean_producer(&block->code[block->size - 3]) == FALSE || block->fallthrough < 0 || taken[i] * 2 <= counts[i]) {
+            continue;
+        }
+        int fallthrough = block->fallthrough;
+        new_block_label(function, fallthrough);
+        block->code[block->size - 2] = block->code[block->size - 1];
+        strcpy(block->code[block->size - 2].name, function->blocks[fallthrough].label);
+        block->size -= 1;
+        block->fallthrough = block->target;
+        block->target = fallthrough;
+        taken[i] = counts[i] - taken[i];
+    }
+
+    int *order = (int *)malloc(sizeof(int) * (function->size + 1));
+    char *placed = (char *)calloc(function->size + 1, sizeof(char));
+    int current = 0;
+    order[0] = 0;
+    placed[0] = TRUE;
+    for (int k = 1; k < function->size; k++) {
+        int next = -1;
+        int successors[2] = {function->blocks[current].fallthrough, function->blocks[current].target};
+        for (int s = 0; s < 2; s++) {
+            int successor = successors[s];
+            if (successor >= 0 && placed[successor] == FALSE &&
+                (next < 0 || edge_count(function, counts, taken, current, successor) > edge_count(function, counts, taken, current, next))) {
+                next = successor;
+            }
+        }
+        // start a new chain at the hottest block left, cold blocks keep their order at the end
+        if (next < 0) {
+            for (int i = 0; i < function->size; i++) {
+                if (placed[i] == FALSE && (next < 0 || counts[i] > counts[next])) {
+                    next = i;
+                }
+            }
+        }
+        order[k] = next;
+        placed[next] = TRUE;
+        current = next;
+    }
+
+    int *renumber = (int *)malloc(sizeof(int) * (function->size + 1));
+    BasicBlock *blocks = (BasicBlock *)malloc(sizeof(BasicBlock) * function->capacity);
+    for (int k = 0; k < function->size; k++) {
+        renumber[order[k]] = k;
+        blocks[k] = function->blocks[order[k]];
+    }
+    for (int k = 0; k < function->size; k++) {
+        blocks[k].fallthrough = blocks[k].fallthrough >= 0 ? renumber[blocks[k].fallthrough] : -1;
+        blocks[k].target = blocks[k].target >= 0 ? renumber[blocks[k].target] : -1;
+    }
+    free(function->blocks);
+    function->blocks = blocks;
+
+    // a fall-through that is not adjacent gets its goto back from lowering, it needs a label to jump to
+    for (int k = 0; k < function->size; k++) {
+        if (function->blocks[k].fallthrough >= 0 && function->blocks[k].fallthrough != k + 1) {
+            new_block_label(function, function->blocks[k].fallthrough);
+        }
+    }
+
+    free(renumber);
+    free(order);
+    free(placed);
+    free(counts);
+    free(taken);
+    update_cfg(function);
+
+    // a hot path can get shorter while the code does not
+    int removed = before - lowered_size(function);
+    return removed > 0 ? removed : 0;
+}
+
+// the block control passes on to when it does nothing else, -1 when it does real work
+int forwarding_block(IrFunction *function, int block) {
+    BasicBlock *forward = &function->blocks[block];
+    if (forward->size == 0) {
+        return forward->fallthrough;
+    }
+    if (forward->size == 1 && forward->code[0].cmd == GOTO_CM) {
+        return forward->target;
+    }
+    return -1;
+}
+
+int is_constant_push(VmInstruction *instruction) {
+    return instruction->cmd == PUSH_CM && instruction->seg == CONST_SEG;
+}
+
+// drops negations an if-goto does not need, returns 1 / 0 when the condition is the constant true / false, -1 otherwise
+int simplify_condition(BasicBlock *block) {
+    VmInstruction *code = block->code;
+    int n = block->size - 1;  // the if-goto
+
+    // not; not
+    while (n >= 2 && code[n - 1].cmd == NOT_CM && code[n - 2].cmd == NOT_CM) {
+        code[n - 2] = code[n];
+        block->size -= 2;
+        n -= 2;
+    }
+    // x = 0 negated is x itself, if-goto only asks for non-zero
+    if (n >= 3 && code[n - 1].cmd == NOT_CM && code[n - 2].cmd == EQ_CM && is_constant_push(&code[n - 3]) && code[n - 3].idx == 0) {
+        code[n - 3] = code[n];
+        block->size -= 3;
+        n -= 3;
+    }
+
+    if (n >= 1 && is_constant_push(&code[n - 1])) {
+        return code[n - 1].idx != 0;
+    }
+    if (n >= 2 && code[n - 1].cmd == NOT_CM && is_constant_push(&code[n - 2])) {
+        return (~code[n - 2].idx & 0xffff) != 0;
+    }
+    return -1;
+}
+
+// jump threading, constant conditions and gotos to the next block
+int simplify_branches(IrFunction *function) {
+    int before = lowered_size(function);
+
+    for (int i = 0; i < function->size; i++) {
+        BasicBlock *block = &function->blocks[i];
+        if (block->target < 0) {
+            continue;
+        }
+        VmInstruction *last = &block->code[block->size - 1];
+
+        if (last->cmd == IF_GOTO_CM) {
+            int constant = simplify_condition(block);
+            last = &block->code[block->size - 1];
+            if (constant >= 0) {
+                // the constant goes too, then the branch is either always or never taken
+                block->size -= block->code[block->size - 2].cmd == NOT_CM ? 3 : 2;
+                if (constant == TRUE) {
+                    last = &block->code[block->size];
+                    last->cmd = GOTO_CM;
+                    last->seg = CONST_SEG;
+                    last->idx = 0;
+                    strcpy(last->name, function->blocks[block->target].label);
+                    block->size += 1;
+                    block->fallthrough = -1;
+                } else {
+                    block->target = -1;
+                    continue;
+                }
+            }
+        }
+
+        // jumps to blocks that only jump on
+        int target = block->target;
+        for (int hops = 0; hops < function->size; hops++) {
+            int next = forwarding_block(function, target);
+            if (next < 0 || next == target) {
+                break;
+            }
+            target = next;
+        }
+        if (target != block->target) {
+            new_block_label(function, target);
+            block->target = target;
+            strcpy(last->name, function->blocks[target].label);
+        }
+
+        if (last->cmd == GOTO_CM && block->target == i + 1) {
+            block->size -= 1;
+            block->fallthrough = block->target;
+            block->target = -1;
+        }
+    }
+
+    update_cfg(function);
+    remove_unreachable_blocks(function);
+    int removed = before - lowered_size(function);
+    return removed > 0 ? removed : 0;
+}
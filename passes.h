@@ -0,0 +1,23 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include "ir.h"
+
+// subroutine passes over a function's control-flow graph, registered in InitCompiler
+
+// compute loop-invariant expressions once in a preheader and keep them in new locals
+int hoist_loop_invariants(IrFunction *function);
+
+// drop stores to locals, arguments, temps and pointers that are never read, with their values when those have no effect
+int remove_dead_stores(IrFunction *function);
+
+// local value numbering, a tree computed again in the same block reads the first result back from a temp or local
+int number_values(IrFunction *function);
+
+// thread jumps through blocks that only jump on, fold constant conditions and drop double negations
+int simplify_branches(IrFunction *function);
+
+// with a profile loaded, order blocks so the hot successor of every block falls through
+int layout_blocks(IrFunction *function);
+
+#endif
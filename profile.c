@@ -0,0 +1,115 @@
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRUE 1
+#define FALSE 0
+
+ProfileRecord *profile_records = NULL;
+int profile_record_count = 0;
+long long profile_calls = 0;
+
+int load_profile(char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        printf("can not open profile %s\n", path);
+        return FALSE;
+    }
+
+    free_profile();
+    int capacity = 64;
+    profile_records = (ProfileRecord *)malloc(sizeof(ProfileRecord) * capacity);
+
+    char line[512];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number += 1;
+        if (line[0] == '\n' || line[0] == '#') {
+            continue;
+        }
+        if (profile_record_count == capacity) {
+            capacity *= 2;
+            profile_records = (ProfileRecord *)realloc(profile_records, sizeof(ProfileRecord) * capacity);
+        }
+
+        ProfileRecord *record = &profile_records[profile_record_count];
+        char kind[16];
+        record->label[0] = '\0';
+        record->taken = 0;
+        int ok = FALSE;
+        if (sscanf(line, "%15s", kind) == 1 && strcmp(kind, "function") == 0) {
+            record->kind = 'f';
+            ok = sscanf(line, "%15s %127s %lld", kind, record->function, &record->count) == 3;
+            profile_calls += record->count;
+        } else if (strcmp(kind, "block") == 0) {
+            record->kind = 'b';
+            ok = sscanf(line, "%15s %127s %127s %lld", kind, record->function, record->label, &record->count) == 4;
+        } else if (strcmp(kind, "branch") == 0) {
+            record->kind = 'r';
+            ok = sscanf(line, "%15s %127s %127s %lld %lld", kind, record->function, record->label, &record->count, &record->taken) == 5;
+        }
+        if (ok == FALSE) {
+            printf("%s:%d: malformed profile line\n", path, line_number);
+            fclose(file);
+            free_profile();
+            return FALSE;
+        }
+        profile_record_count += 1;
+    }
+    fclose(file);
+    return TRUE;
+}
+
+void free_profile() {
+    free(profile_records);
+    profile_records = NULL;
+    profile_record_count = 0;
+    profile_calls = 0;
+}
+
+int has_profile() {
+    return profile_records != NULL;
+}
+
+long long profile_total_calls() {
+    return profile_calls;
+}
+
+ProfileRecord *find_profile_record(char kind, char *function, char *label) {
+    for (int i = 0; i < profile_record_count; i++) {
+        ProfileRecord *record = &profile_records[i];
+        if (record->kind == kind && strcmp(record->function, function) == 0 && (label == NULL || strcmp(record->label, label) == 0)) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+// times the function was called, -1 when the profile does not know it
+long long profile_function_count(char *function) {
+    ProfileRecord *record = find_profile_record('f', function, NULL);
+    return record != NULL ? record->count : -1;
+}
+
+long long profile_block_count(char *function, char *label) {
+    ProfileRecord *record = find_profile_record('b', function, label);
+    return record != NULL ? record->count : -1;
+}
+
+// sums every if-goto of the function jumping to label, FALSE when there is none
+int profile_branch(char *function, char *label, long long *executed, long long *taken) {
+    *executed = 0;
+    *taken = 0;
+    int found = FALSE;
+    for (int i = 0; i < profile_record_count; i++) {
+        ProfileRecord *record = &profile_records[i];
+        if (record->kind == 'r' && strcmp(record->function, function) == 0 && strcmp(record->label, label) == 0) {
+            *executed += record->count;
+            *taken += record->taken;
+            found = TRUE;
+        }
+    }
+    return found;
+}
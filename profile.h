@@ -0,0 +1,23 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// execution profile written by write_execution_profile(), read back to guide the next compile
+
+// one line of the profile, label is empty for function records
+typedef struct {
+    char kind;  // 'f'unction, 'b'lock or b'r'anch
+    char function[128];
+    char label[128];
+    long long count;  // calls, block entries or if-goto executions
+    long long taken;  // jumps taken, branches only
+} ProfileRecord;
+
+int load_profile(char *path);
+void free_profile();
+int has_profile();
+long long profile_total_calls();
+long long profile_function_count(char *function);
+long long profile_block_count(char *function, char *label);
+int profile_branch(char *function, char *label, long long *executed, long long *taken);
+
+#endif
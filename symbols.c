@@ -7,6 +7,7 @@
 SymbolTable *program_table = NULL;
 UncheckedSymbol *symbol_list = NULL;
 int symbol_list_idx = 0;
+int symbol_list_capacity = 0;
 
 SymbolTable *get_program_table() {
     return program_table;
@@ -71,6 +72,11 @@ void add_undeclare(Token token, char *class_name) {
         }
     }
 
+    if (symbol_list_idx == symbol_list_capacity) {
+        symbol_list_capacity *= 2;
+        symbol_list = (UncheckedSymbol *)realloc(symbol_list, sizeof(UncheckedSymbol) * symbol_list_capacity);
+    }
+
     strncpy(symbol_list[symbol_list_idx].this, class_name, LEXEME_LEN);
     symbol_list[symbol_list_idx].token = token;
 
@@ -107,13 +113,55 @@ ParserInfo find_undeclared_identifier() {
 
 void free_table(SymbolTable *table) {
     for (int i = 0; i < table->capacity; i++) {
+        if (table->rows[i] != NULL && table->rows[i]->child_table != NULL) {
+            free_table(table->rows[i]->child_table);
+        }
         free(table->rows[i]);
     }
     free(table->rows);
     free(table);
 }
 
+int count_unchecked_symbols() {
+    return symbol_list_idx;
+}
+
+// drop every class after the first class_count and every unchecked symbol after the first unchecked_count,
+// the tables before stay as they are, e.g. the library's between two compiles
+void reset_program_table(int class_count, int unchecked_count) {
+    for (int i = class_count; i < program_table->size; i++) {
+        TableRow *row = program_table->rows[i];
+        if (row->child_table != NULL) {
+            free_table(row->child_table);
+        }
+        program_table->symbol_kind_cnt[row->kind] -= 1;
+        free(row);
+        program_table->rows[i] = NULL;
+    }
+    if (class_count < program_table->size) {
+        program_table->size = class_count;
+    }
+    if (unchecked_count < symbol_list_idx) {
+        symbol_list_idx = unchecked_count;
+    }
+}
+
 int init_symbol() {
+    program_table = create_table(PROGRAM_SCOPE, "program");
+    symbol_list_idx = 0;
+    symbol_list_capacity = 256;
+    symbol_list = (UncheckedSymbol *)malloc(sizeof(UncheckedSymbol) * symbol_list_capacity);
+    return 1;
+}
 
+int stop_symbol() {
+    if (program_table != NULL) {
+        free_table(program_table);
+        program_table = NULL;
+    }
+    free(symbol_list);
+    symbol_list = NULL;
+    symbol_list_idx = 0;
+    symbol_list_capacity = 0;
     return 1;
 }
\ No newline at end of file
@@ -59,5 +59,7 @@ int insert_symbol_into_table(SymbolTable *parent_table, SymbolTable *child_table
 TableRow *find_symbol_in_table(SymbolTable *table, char *name);
 void add_undeclare(Token token, char *class_name);
 ParserInfo find_undeclared_identifier();
+int count_unchecked_symbols();
+void reset_program_table(int class_count, int unchecked_count);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRUE 1
+#define FALSE 0
+
+#define ROM_SIZE 32768
+#define RAM_SIZE 32768
+#define LINE_LEN 256
+#define MAX_STEPS 1000000000LL  // a program that runs longer is taken to loop forever
+
+typedef struct {
+    char name[LINE_LEN];
+    int value;
+} Symbol;
+
+typedef struct {
+    int is_address;
+    int value;  // the address, or the index of the computation in computations
+    int uses_memory;
+    int dest;   // A = 4, D = 2, M = 1
+    int jump;   // index in jumps
+} Word;
+
+// the computations of the Hack instruction set, M stands for A with the a-bit set
+char *computations[] = {"0", "1", "-1", "D", "A", "!D", "!A", "-D", "-A", "D+1", "A+1", "D-1", "A-1",
+                        "D+A", "D-A", "A-D", "D&A", "D|A"};
+char *jumps[] = {"", "JGT", "JEQ", "JGE", "JLT", "JNE", "JLE", "JMP"};
+
+Symbol *symbols = NULL;
+int symbol_count = 0;
+Word rom[ROM_SIZE];
+int rom_size = 0;
+int16_t ram[RAM_SIZE];
+
+int find_symbol(char *name) {
+    for (int i = 0; i < symbol_count; i++) {
+        if (strcmp(symbols[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void add_symbol(char *name, int value) {
+    symbols = (Symbol *)realloc(symbols, sizeof(Symbol) * (symbol_count + 1));
+    strcpy(symbols[symbol_count].name, name);
+    symbols[symbol_count].value = value;
+    symbol_count += 1;
+}
+
+// the line without comments and white space, empty when nothing is left
+void strip_line(char *line) {
+    char *comment = strstr(line, "//");
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+    int length = 0;
+    for (int i = 0; line[i] != '\0'; i++) {
+        if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r' && line[i] != '\n') {
+            line[length++] = line[i];
+        }
+    }
+    line[length] = '\0';
+}
+
+int parse_computation(char *text, Word *word) {
+    char computation[LINE_LEN];
+    strcpy(computation, text);
+    word->uses_memory = FALSE;
+    for (int i = 0; computation[i] != '\0'; i++) {
+        if (computation[i] == 'M') {
+            computation[i] = 'A';
+            word->uses_memory = TRUE;
+        }
+    }
+    for (int i = 0; i < (int)(sizeof(computations) / sizeof(computations[0])); i++) {
+        if (strcmp(computations[i], computation) == 0) {
+            word->value = i;
+            // A and M can not be read by the same instruction
+            return word->uses_memory == FALSE || strchr(text, 'A') == NULL;
+        }
+    }
+    return FALSE;
+}
+
+int parse_instruction(char *line, Word *word) {
+    word->dest = 0;
+    word->jump = 0;
+    char *equals = strchr(line, '=');
+    if (equals != NULL) {
+        for (char *c = line; c < equals; c++) {
+            if (*c == 'A') {
+                word->dest |= 4;
+            } else if (*c == 'D') {
+                word->dest |= 2;
+            } else if (*c == 'M') {
+                word->dest |= 1;
+            } else {
+                return FALSE;
+            }
+        }
+        line = equals + 1;
+    }
+    char *semicolon = strchr(line, ';');
+    if (semicolon != NULL) {
+        *semicolon = '\0';
+        word->jump = -1;
+        for (int i = 1; i < 8; i++) {
+            if (strcmp(jumps[i], semicolon + 1) == 0) {
+                word->jump = i;
+            }
+        }
+        if (word->jump < 0) {
+            return FALSE;
+        }
+    }
+    return parse_computation(line, word);
+}
+
+// two passes over the file, the first places the labels and the second the instructions
+int assemble(char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        printf("can not open %s\n", path);
+        return FALSE;
+    }
+    char *predefined[] = {"SP", "LCL", "ARG", "THIS", "THAT"};
+    for (int i = 0; i < 5; i++) {
+        add_symbol(predefined[i], i);
+    }
+    for (int i = 0; i < 16; i++) {
+        char name[8];
+        sprintf(name, "R%d", i);
+        add_symbol(name, i);
+    }
+    add_symbol("SCREEN", 16384);
+    add_symbol("KBD", 24576);
+
+    char line[LINE_LEN];
+    int words = 0;
+    while (fgets(line, LINE_LEN, file) != NULL) {
+        strip_line(line);
+        if (line[0] == '(') {
+            line[strlen(line) - 1] = '\0';
+            if (find_symbol(line + 1) >= 0) {
+                printf("label %s defined twice\n", line + 1);
+                fclose(file);
+                return FALSE;
+            }
+            add_symbol(line + 1, words);
+        } else if (line[0] != '\0') {
+            words += 1;
+        }
+    }
+    if (words > ROM_SIZE) {
+        printf("%d words do not fit in the ROM\n", words);
+        fclose(file);
+        return FALSE;
+    }
+
+    rewind(file);
+    int next_variable = 16;
+    int line_number = 0;
+    while (fgets(line, LINE_LEN, file) != NULL) {
+        line_number += 1;
+        strip_line(line);
+        if (line[0] == '\0' || line[0] == '(') {
+            continue;
+        }
+        Word *word = &rom[rom_size++];
+        word->is_address = line[0] == '@';
+        if (word->is_address == FALSE) {
+            if (parse_instruction(line, word) == FALSE) {
+                printf("%s:%d: not a Hack instruction\n", path, line_number);
+                fclose(file);
+                return FALSE;
+            }
+        } else if (line[1] >= '0' && line[1] <= '9') {
+            word->value = atoi(line + 1);
+        } else {
+            int symbol = find_symbol(line + 1);
+            if (symbol < 0) {
+                add_symbol(line + 1, next_variable++);
+                symbol = symbol_count - 1;
+            }
+            word->value = symbols[symbol].value;
+        }
+        if (word->is_address == TRUE && (word->value < 0 || word->value >= ROM_SIZE)) {
+            printf("%s:%d: address out of range\n", path, line_number);
+            fclose(file);
+            return FALSE;
+        }
+    }
+    fclose(file);
+    return TRUE;
+}
+
+int16_t compute(int computation, int16_t d, int16_t a) {
+    switch (computation) {
+        case 0: return 0;
+        case 1: return 1;
+        case 2: return -1;
+        case 3: return d;
+        case 4: return a;
+        case 5: return ~d;
+        case 6: return ~a;
+        case 7: return -d;
+        case 8: return -a;
+        case 9: return d + 1;
+        case 10: return a + 1;
+        case 11: return d - 1;
+        case 12: return a - 1;
+        case 13: return d + a;
+        case 14: return d - a;
+        case 15: return a - d;
+        case 16: return d & a;
+        default: return d | a;
+    }
+}
+
+int is_jump_taken(int jump, int16_t value) {
+    return ((jump & 4) && value < 0) || ((jump & 2) && value == 0) || ((jump & 1) && value > 0);
+}
+
+// hackcpu <file .asm>, assembles the program and runs it from address 0 until it reaches an endless
+// "@label; 0;JMP" loop on itself, like the one the bootstrap halts in after Sys.init; prints what Sys.init
+// returned, the word below the stack pointer, and the instructions it took to stderr
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        printf("usage: hackcpu <file .asm>\n");
+        return 2;
+    }
+    if (assemble(argv[1]) == FALSE) {
+        return 2;
+    }
+
+    int16_t a = 0, d = 0;
+    int pc = 0;
+    long long steps = 0;
+    int halted = FALSE;
+    while (halted == FALSE && pc < rom_size && steps < MAX_STEPS) {
+        Word *word = &rom[pc];
+        steps += 1;
+        if (word->is_address == TRUE) {
+            a = word->value;
+            pc += 1;
+            continue;
+        }
+        int address = (uint16_t)a % RAM_SIZE;
+        int16_t value = compute(word->value, d, word->uses_memory == TRUE ? ram[address] : a);
+        int target = (uint16_t)a;
+        if (word->dest & 1) {
+            ram[address] = value;
+        }
+        if (word->dest & 4) {
+            a = value;
+        }
+        if (word->dest & 2) {
+            d = value;
+        }
+        if (is_jump_taken(word->jump, value)) {
+            halted = word->jump == 7 && pc > 0 && target == pc - 1 && rom[pc - 1].is_address == TRUE;
+            pc = target;
+        } else {
+            pc += 1;
+        }
+    }
+
+    int top = (uint16_t)ram[0] % RAM_SIZE;
+    printf("returned %d%s\n", top > 0 ? ram[top - 1] : 0, halted == TRUE ? "" : " (failed)");
+    fprintf(stderr, "%lld instructions\n", steps);
+    free(symbols);
+    return halted == TRUE ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "batch.h"
+#include "compiler.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// jackbatch [-j<jobs>] [flags] <program dir>..., compiles every directory against the library in the working
+// directory, the flags hold for all of them
+int main(int argc, char **argv) {
+    char **dir_names = (char **)malloc(sizeof(char *) * argc);
+    int count = 0;
+    int jobs = 1;
+    InitCompiler();
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'j') {
+            jobs = atoi(argv[i] + 2);
+        } else if (argv[i][0] == '-') {
+            if (set_compiler_flag(argv[i]) == FALSE) {
+                return 2;
+            }
+        } else {
+            dir_names[count++] = argv[i];
+        }
+    }
+    if (count == 0) {
+        printf("usage: jackbatch [-j<jobs>] [flags] <program dir>...\n");
+        return 2;
+    }
+
+    int failed = compile_batch(dir_names, count, jobs);
+    StopCompiler();
+    free(dir_names);
+    return failed != 0;
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+
+#include "compiler.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// jackc <program dir> [flags], run from the directory holding the library classes
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: jackc <program dir> [flags]\n");
+        return 2;
+    }
+    InitCompiler();
+    for (int i = 2; i < argc; i++) {
+        if (set_compiler_flag(argv[i]) == FALSE) {
+            return 2;
+        }
+    }
+
+    ParserInfo parser_info = compile(argv[1]);
+    if (parser_info.er != none) {
+        print_compile_error(parser_info);
+    }
+    StopCompiler();
+    return parser_info.er != none;
+}
@@ -0,0 +1,24 @@
+#include <stdio.h>
+
+#include "transpiler.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// jackcc <program dir> <output .c>, translates the .vm files in the directory to a C program,
+// build it with natives.c from the compiler sources
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        printf("usage: jackcc <program dir> <output .c>\n");
+        return 2;
+    }
+
+    VmProgram program;
+    init_vm_program(&program);
+    if (load_vm_program(&program, argv[1]) == FALSE) {
+        return 2;
+    }
+    int ok = translate_to_c(&program, argv[2]);
+    free_vm_program(&program);
+    return ok == TRUE ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "daemon.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// jackd --serve [flags] | --stop | <program dir> [flags], runs the compiler daemon on jackc.sock in the working
+// directory, stops it, or has it compile a program directory; run from the directory holding the library classes
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: jackd --serve [flags] | --stop | <program dir> [flags]\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "--stop") == 0) {
+        return stop_compiler_daemon(DAEMON_SOCKET) == TRUE ? 0 : 1;
+    }
+
+    InitCompiler();
+    if (strcmp(argv[1], "--serve") == 0) {
+        for (int i = 2; i < argc; i++) {
+            if (set_compiler_flag(argv[i]) == FALSE) {
+                return 2;
+            }
+        }
+        int ok = run_compiler_daemon(DAEMON_SOCKET);
+        StopCompiler();
+        return ok == TRUE ? 0 : 1;
+    }
+
+    // exits with the status the daemon's compiler would have exited with
+    ParserInfo parser_info;
+    if (request_compile(DAEMON_SOCKET, argv[1], argv + 2, argc - 2, &parser_info) == FALSE) {
+        printf("no daemon listens on %s\n", DAEMON_SOCKET);
+        return 2;
+    }
+    if (parser_info.er != none) {
+        print_compile_error(parser_info);
+    }
+    StopCompiler();
+    return parser_info.er != none;
+}
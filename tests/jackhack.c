@@ -0,0 +1,26 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hack.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// jackhack [--size] <program dir> <output .asm>, translates the .vm files in the directory to Hack assembly,
+// inlining calls, returns and comparisons unless --size is given
+int main(int argc, char **argv) {
+    int size = argc > 3 && strcmp(argv[1], "--size") == 0;
+    if (argc != 3 + size) {
+        printf("usage: jackhack [--size] <program dir> <output .asm>\n");
+        return 2;
+    }
+
+    VmProgram program;
+    init_vm_program(&program);
+    if (load_vm_program(&program, argv[1 + size]) == FALSE) {
+        return 2;
+    }
+    int ok = translate_to_hack(&program, argv[2 + size], size == TRUE ? OPTIMIZE_SIZE : OPTIMIZE_SPEED);
+    free_vm_program(&program);
+    return ok == TRUE ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "interpreter.h"
+#include "jit.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define MAX_STEPS 100000000LL  // a kernel that runs longer is taken to loop forever
+
+// jackvm [--jit | --profile=<path>] <program dir>, runs Main.main of the .vm files in the directory;
+// what the program printed and returned goes to stdout, the instructions and time it took to stderr
+int main(int argc, char **argv) {
+    int jit = argc > 2 && strcmp(argv[1], "--jit") == 0;
+    char *profile = argc > 2 && strncmp(argv[1], "--profile=", 10) == 0 ? argv[1] + 10 : NULL;
+    int options = jit == TRUE || profile != NULL;
+    if (argc != 2 + options) {
+        printf("usage: jackvm [--jit | --profile=<path>] <program dir>\n");
+        return 2;
+    }
+
+    VmProgram program;
+    init_vm_program(&program);
+    Interpreter *vm = (Interpreter *)malloc(sizeof(Interpreter));
+    init_interpreter(vm);
+    if (profile != NULL) {
+        collect_execution_profile(vm);
+    }
+    if (load_vm_program(&program, argv[1 + options]) == FALSE || load_interpreter(vm, &program) == FALSE) {
+        return 2;
+    }
+    // machines without the JIT run the kernel interpreted
+    if (jit == TRUE && enable_jit(vm) == FALSE) {
+        fprintf(stderr, "jit: not available, interpreting\n");
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ok = run_interpreter(vm, "Main.main", MAX_STEPS);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    printf("\nreturned %d%s\n", vm->result, ok == TRUE ? "" : " (failed)");
+    fprintf(stderr, "%lld instructions %.3f ms\n", vm->steps, elapsed);
+    if (profile != NULL && write_execution_profile(vm, profile) == FALSE) {
+        ok = FALSE;
+    }
+    stop_interpreter(vm);
+    free(vm);
+    free_vm_program(&program);
+    return ok == TRUE ? 0 : 1;
+}
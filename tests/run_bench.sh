@@ -0,0 +1,112 @@
+#!/bin/sh
+# builds the compiler and the VM interpreter from the sources above, compiles every kernel in bench/ as parsed
+# (-O0) and fully optimized (-O2, or the flags given), and checks that the optimized build prints and returns the
+# same as the unoptimized one, interpreted, with the JIT and translated to C, and so does an optimized build guided
+# by the profile of the unoptimized run; prints the instructions each build executed. The kernel in hack/ replaces
+# Sys.init and calls no OS, it is also translated to Hack assembly in both modes and run on the Hack CPU
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+flags=${*:--O2}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cc=${CC:-cc}
+sources=$(ls "$root"/*.c)
+if ! $cc -O2 -I"$root" -o "$work/jackc" "$here/jackc.c" $sources -lm ||
+   ! $cc -O2 -I"$root" -o "$work/jackvm" "$here/jackvm.c" $sources -lm ||
+   ! $cc -O2 -I"$root" -o "$work/jackcc" "$here/jackcc.c" $sources -lm ||
+   ! $cc -O2 -I"$root" -o "$work/jackhack" "$here/jackhack.c" $sources -lm ||
+   ! $cc -O2 -o "$work/hackcpu" "$here/hackcpu.c"; then
+    echo "build failed"
+    exit 1
+fi
+
+# the library classes are read from the working directory
+cd "$here/os" || exit 1
+
+failed=0
+printf "%-12s %12s %12s %12s %10s %10s  %s\n" kernel "-O0 instr" "$flags instr" "profile instr" "-O0 ms" "jit ms" result
+for kernel in "$here"/bench/*/; do
+    name=$(basename "$kernel")
+    mkdir -p "$work/O0/$name" "$work/opt/$name" "$work/pgo/$name"
+    cp "$kernel"*.jack "$work/O0/$name"
+    cp "$kernel"*.jack "$work/opt/$name"
+    cp "$kernel"*.jack "$work/pgo/$name"
+    if ! "$work/jackc" "$work/O0/$name" -O0 > "$work/$name.log" ||
+       ! "$work/jackc" "$work/opt/$name" $flags >> "$work/$name.log" ||
+       ! "$work/jackvm" --profile="$work/$name.profile" "$work/O0/$name" > /dev/null 2>&1 ||
+       ! "$work/jackc" "$work/pgo/$name" $flags -fprofile-use="$work/$name.profile" >> "$work/$name.log"; then
+        printf "%-12s compile failed\n" "$name"
+        cat "$work/$name.log"
+        failed=$((failed + 1))
+        continue
+    fi
+
+    "$work/jackvm" "$work/O0/$name" > "$work/$name.expected" 2> "$work/$name.O0"
+    status=ok
+    for run in "opt" "opt --jit" "pgo"; do
+        build=${run%% *}
+        mode=${run#"$build"}
+        "$work/jackvm" $mode "$work/$build/$name" > "$work/$name.actual" 2> "$work/$name.$build$mode"
+        if ! cmp -s "$work/$name.expected" "$work/$name.actual"; then
+            status="differs ($run): $(tail -n 1 "$work/$name.actual") instead of $(tail -n 1 "$work/$name.expected")"
+            failed=$((failed + 1))
+            break
+        fi
+    done
+    if [ "$status" = ok ]; then
+        if ! "$work/jackcc" "$work/opt/$name" "$work/$name.c" > "$work/$name.log" ||
+           ! $cc -O2 -DPRINT_RESULT -I"$root" -o "$work/$name.bin" "$work/$name.c" "$root/natives.c" 2>> "$work/$name.log"; then
+            status="C build failed: $(head -n 1 "$work/$name.log")"
+            failed=$((failed + 1))
+        elif ! "$work/$name.bin" > "$work/$name.actual" || ! cmp -s "$work/$name.expected" "$work/$name.actual"; then
+            status="differs (c): $(tail -n 1 "$work/$name.actual") instead of $(tail -n 1 "$work/$name.expected")"
+            failed=$((failed + 1))
+        fi
+    fi
+    if grep -q "(failed)" "$work/$name.expected"; then
+        status="-O0 build failed"
+        failed=$((failed + 1))
+    fi
+
+    printf "%-12s %12s %12s %12s %10s %10s  %s\n" "$name" "$(cut -d ' ' -f 1 "$work/$name.O0")" \
+        "$(cut -d ' ' -f 1 "$work/$name.opt")" "$(cut -d ' ' -f 1 "$work/$name.pgo")" "$(cut -d ' ' -f 3 "$work/$name.O0")" \
+        "$(tail -n 1 "$work/$name.opt --jit" | cut -d ' ' -f 3)" "$status"
+done
+
+# without the library classes, the kernel brings its own Sys
+mkdir -p "$work/empty" "$work/hack/O0" "$work/hack/opt"
+cp "$here"/hack/*.jack "$work/hack/O0"
+cp "$here"/hack/*.jack "$work/hack/opt"
+cd "$work/empty" || exit 1
+echo
+printf "%-12s %12s %12s  %s\n" hack "ROM words" instr result
+if ! "$work/jackc" "$work/hack/O0" -O0 > "$work/hack.log" || ! "$work/jackc" "$work/hack/opt" $flags >> "$work/hack.log"; then
+    printf "%-12s compile failed\n" hack
+    cat "$work/hack.log"
+    failed=$((failed + 1))
+else
+    expected=$("$work/jackvm" "$work/hack/O0" 2> /dev/null | tail -n 1)
+    for build in O0 opt; do
+        for mode in speed size; do
+            option=$([ "$mode" = size ] && echo --size)
+            status=ok
+            : > "$work/hack.steps"
+            if ! "$work/jackhack" $option "$work/hack/$build" "$work/$build.$mode.asm" > "$work/hack.log"; then
+                status="translation failed: $(cat "$work/hack.log")"
+            else
+                actual=$("$work/hackcpu" "$work/$build.$mode.asm" 2> "$work/hack.steps")
+                [ "$actual" = "$expected" ] || status="differs: $actual instead of $expected"
+            fi
+            [ "$status" = ok ] || failed=$((failed + 1))
+            printf "%-12s %12s %12s  %s\n" "$build $mode" "$(cut -d ' ' -f 2 "$work/hack.log")" \
+                "$(cut -d ' ' -f 1 "$work/hack.steps")" "$status"
+        done
+    done
+fi
+
+if [ "$failed" -ne 0 ]; then
+    echo "$failed kernel(s) failed"
+    exit 1
+fi
@@ -0,0 +1,153 @@
+#!/bin/sh
+# builds the compiler drivers from the sources above and checks the build modes on the folding kernel: incremental
+# rebuilds after a body and an interface edit, the library interface file, a cache hit, a batch with a directory
+# that does not exist, a daemon round trip and a rebuild in --watch mode; every build runs the same as a clean one
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$here")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cc=${CC:-cc}
+sources=$(ls "$root"/*.c)
+for driver in jackc jackvm jackd jackbatch; do
+    if ! $cc -O2 -I"$root" -o "$work/$driver" "$here/$driver.c" $sources -lm; then
+        echo "build failed"
+        exit 1
+    fi
+done
+
+# the library classes are read from the working directory, the daemon's socket goes there as well
+mkdir -p "$work/os"
+cp "$here"/os/*.jack "$work/os"
+cd "$work/os" || exit 1
+
+failed=0
+
+# check <name> <log> <expected line>, the line has to be in what the build printed
+check() {
+    if grep -qF -- "$3" "$2"; then
+        printf "%-28s ok\n" "$1"
+    else
+        printf "%-28s missing \"%s\" in:\n" "$1" "$3"
+        cat "$2"
+        failed=$((failed + 1))
+    fi
+}
+
+# check_run <name> <program dir>, the built program returns what a clean build of the same sources does
+check_run() {
+    rm -rf "$work/clean"
+    mkdir -p "$work/clean"
+    cp "$2"/*.jack "$work/clean"
+    "$work/jackc" "$work/clean" > /dev/null
+    "$work/jackvm" "$work/clean" > "$work/expected" 2> /dev/null
+    "$work/jackvm" "$2" > "$work/actual" 2> /dev/null
+    if cmp -s "$work/expected" "$work/actual"; then
+        printf "%-28s ok\n" "$1"
+    else
+        printf "%-28s %s instead of %s\n" "$1" "$(tail -n 1 "$work/actual")" "$(tail -n 1 "$work/expected")"
+        failed=$((failed + 1))
+    fi
+}
+
+# the library's interface file is written on the first build and read on the next
+mkdir -p "$work/program"
+cp "$here"/bench/folding/*.jack "$work/program"
+"$work/jackc" "$work/program" > /dev/null
+if [ -f "$work/program/.jcbuild/library.jif" ]; then
+    printf "%-28s ok\n" "interface file"
+else
+    printf "%-28s no library.jif in the build directory\n" "interface file"
+    failed=$((failed + 1))
+fi
+"$work/jackc" "$work/program" > /dev/null
+check_run "interface file run" "$work/program"
+
+program="$work/incremental"
+mkdir -p "$program"
+cp "$here"/bench/folding/*.jack "$program"
+"$work/jackc" "$program" -fincremental > "$work/log"
+check "incremental first build" "$work/log" "incremental: 3 of 3 classes to rebuild"
+"$work/jackc" "$program" -fincremental > "$work/log"
+check "incremental no change" "$work/log" "incremental: 0 of 3 classes to rebuild"
+
+# a body edit rebuilds the class alone, an interface edit its users as well
+sed 's/return 0; } return k + Vec.sum/return 1; } return k + Vec.sum/' "$here/bench/folding/Vec.jack" > "$program/Vec.jack"
+"$work/jackc" "$program" -fincremental > "$work/log"
+check "incremental body edit" "$work/log" "incremental: 1 of 3 classes to rebuild"
+check_run "incremental body edit run" "$program"
+sed 's/^}$/    function int extra() { return 1; }\n}/' "$program/Vec.jack" > "$work/Vec.jack"
+cp "$work/Vec.jack" "$program/Vec.jack"
+"$work/jackc" "$program" -fincremental > "$work/log"
+check "incremental interface edit" "$work/log" "incremental: 2 of 3 classes to rebuild"
+check_run "incremental interface run" "$program"
+
+# a second directory with the same classes and flags takes all of them from the cache
+mkdir -p "$work/cached" "$work/copy"
+cp "$here"/bench/folding/*.jack "$work/cached"
+cp "$here"/bench/folding/*.jack "$work/copy"
+"$work/jackc" "$work/cached" -fcache-dir="$work/cache" > "$work/log"
+check "cache first build" "$work/log" "cache: 0 hits, 3 misses"
+"$work/jackc" "$work/copy" -fcache-dir="$work/cache" > "$work/log"
+check "cache hit" "$work/log" "cache: 3 hits, 0 misses"
+check_run "cache hit run" "$work/copy"
+
+# one directory failing does not stop the others
+mkdir -p "$work/batch"
+cp "$here"/bench/folding/*.jack "$work/batch"
+"$work/jackbatch" -j2 "$work/batch" "$work/missing" > "$work/log"
+status=$?
+check "batch" "$work/log" "batch: 1 of 2 directories compiled"
+check "batch failing directory" "$work/log" "== $work/missing: failed"
+[ "$status" -eq 1 ] || { echo "batch exited with $status instead of 1"; failed=$((failed + 1)); }
+check_run "batch run" "$work/batch"
+
+# a request for a directory that does not exist fails alone, the daemon keeps serving
+mkdir -p "$work/served"
+cp "$here"/bench/folding/*.jack "$work/served"
+"$work/jackd" --serve > "$work/daemon.log" &
+daemon=$!
+tries=0
+while [ ! -S jackc.sock ] && [ "$tries" -lt 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+"$work/jackd" "$work/missing" > "$work/log"
+status=$?
+check "daemon missing directory" "$work/log" "Directory $work/missing does not exist."
+[ "$status" -eq 1 ] || { echo "daemon request exited with $status instead of 1"; failed=$((failed + 1)); }
+"$work/jackd" "$work/served" -O2 > "$work/log"
+status=$?
+[ "$status" -eq 0 ] || { echo "daemon request exited with $status instead of 0"; cat "$work/log"; failed=$((failed + 1)); }
+check_run "daemon run" "$work/served"
+"$work/jackd" --stop
+wait "$daemon"
+check "daemon log" "$work/daemon.log" "/missing failed"
+check "daemon stop" "$work/daemon.log" "daemon: stopped"
+
+# saving a class rebuilds the program
+mkdir -p "$work/watched"
+cp "$here"/bench/folding/*.jack "$work/watched"
+"$work/jackc" "$work/watched" --watch > "$work/watch.log" &
+watcher=$!
+tries=0
+while ! grep -q "watch: waiting" "$work/watch.log" && [ "$tries" -lt 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+cp "$program/Vec.jack" "$work/watched/Vec.jack"
+tries=0
+while ! grep -q "rebuilt" "$work/watch.log" && [ "$tries" -lt 50 ]; do
+    sleep 0.1
+    tries=$((tries + 1))
+done
+kill "$watcher"
+wait "$watcher" 2> /dev/null
+check "watch rebuild" "$work/watch.log" "rebuilt $work/watched"
+check_run "watch run" "$work/watched"
+
+if [ "$failed" -ne 0 ]; then
+    echo "$failed check(s) failed"
+    exit 1
+fi
@@ -0,0 +1,486 @@
+#include "transpiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interpreter.h"
+#include "natives.h"
+
+#define TRUE 1
+#define FALSE 0
+
+// one VM function and where its body lives
+typedef struct {
+    char name[VM_NAME_LEN];
+    VmFile *file;
+    int start;        // index of the function command
+    int end;          // one past the last instruction of the body
+    int args;         // highest argument used by the body or passed by any caller
+    int static_base;  // RAM address of the class's static 0
+} CFunction;
+
+FILE *c_file;
+CFunction *c_functions = NULL;
+int c_function_count = 0;
+int *c_natives = NULL;  // native indices called by the program, position is the slot in os[]
+int c_native_count = 0;
+
+// Class.subroutine becomes Class__subroutine
+void write_c_identifier(char *name) {
+    for (char *c = name; *c != '\0'; c++) {
+        if (*c == '.') {
+            fputs("__", c_file);
+        } else if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '_') {
+            fputc(*c, c_file);
+        } else {
+            fputc('_', c_file);
+        }
+    }
+}
+
+int find_c_function(char *name) {
+    for (int i = 0; i < c_function_count; i++) {
+        if (strcmp(c_functions[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// slot in the generated os[] table, added on first use
+int native_slot(int native) {
+    for (int i = 0; i < c_native_count; i++) {
+        if (c_natives[i] == native) {
+            return i;
+        }
+    }
+    c_natives = (int *)realloc(c_natives, sizeof(int) * (c_native_count + 1));
+    c_natives[c_native_count] = native;
+    c_native_count += 1;
+    return c_native_count - 1;
+}
+
+// a call goes to the built-in OS when one matches, the same choice the interpreter makes
+int call_native(VmInstruction *instruction) {
+    int native = find_native(instruction->name);
+    if (native >= 0 && get_native(native)->args == instruction->idx) {
+        return native;
+    }
+    return -1;
+}
+
+int collect_c_functions(VmProgram *program) {
+    int count = 0;
+    for (int i = 0; i < program->size; i++) {
+        for (int j = 0; j < program->files[i].size; j++) {
+            if (program->files[i].code[j].cmd == FUNCTION_CM) {
+                count += 1;
+            }
+        }
+    }
+    c_functions = (CFunction *)malloc(sizeof(CFunction) * (count + 1));
+    c_function_count = 0;
+
+    int static_base = STATIC_BASE;
+    for (int i = 0; i < program->size; i++) {
+        VmFile *file = &program->files[i];
+        int statics = 0;
+        for (int j = 0; j < file->size; j++) {
+            VmInstruction *instruction = &file->code[j];
+            if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == STATIC_SEG && instruction->idx + 1 > statics) {
+                statics = instruction->idx + 1;
+            }
+            if (instruction->cmd == FUNCTION_CM) {
+                if (c_function_count > 0 && c_functions[c_function_count - 1].file == file) {
+                    c_functions[c_function_count - 1].end = j;
+                }
+                CFunction *function = &c_functions[c_function_count];
+                strncpy(function->name, instruction->name, VM_NAME_LEN - 1);
+                function->name[VM_NAME_LEN - 1] = '\0';
+                function->file = file;
+                function->start = j;
+                function->end = file->size;
+                function->args = 0;
+                function->static_base = static_base;
+                c_function_count += 1;
+            } else if (c_function_count == 0 || c_functions[c_function_count - 1].file != file) {
+                printf("%s: instruction outside of a function\n", file->path);
+                return FALSE;
+            }
+        }
+        if (static_base + statics > STATIC_LIMIT) {
+            printf("%s: too many static variables\n", file->path);
+            return FALSE;
+        }
+        static_base += statics;
+    }
+
+    // C functions take every argument a caller can pass
+    for (int i = 0; i < c_function_count; i++) {
+        CFunction *function = &c_functions[i];
+        for (int j = function->start + 1; j < function->end; j++) {
+            VmInstruction *instruction = &function->file->code[j];
+            if ((instruction->cmd == PUSH_CM || instruction->cmd == POP_CM) && instruction->seg == ARGUMENT_SEG && instruction->idx + 1 > function->args) {
+                function->args = instruction->idx + 1;
+            }
+            if (instruction->cmd == CALL_CM && call_native(instruction) < 0) {
+                int callee = find_c_function(instruction->name);
+                if (callee < 0) {
+                    printf("undefined function %s\n", instruction->name);
+                    return FALSE;
+                }
+                if (instruction->idx > c_functions[callee].args) {
+                    c_functions[callee].args = instruction->idx;
+                }
+            }
+        }
+    }
+    return TRUE;
+}
+
+int find_c_label(CFunction *function, char *name) {
+    for (int j = function->start + 1; j < function->end; j++) {
+        VmInstruction *instruction = &function->file->code[j];
+        if (instruction->cmd == LABEL_CM && strcmp(instruction->name, name) == 0) {
+            return j - function->start;
+        }
+    }
+    return -1;
+}
+
+// stack depth before every instruction, the VM stack is mapped onto C locals s0, s1, ...
+int analyse_stack(CFunction *function, int *depths, int *referenced, int *max_depth) {
+    int size = function->end - function->start;
+    int *label_depth = (int *)malloc(sizeof(int) * size);
+    for (int k = 0; k < size; k++) {
+        label_depth[k] = -1;
+        referenced[k] = FALSE;
+    }
+
+    int depth = 0;
+    int ok = TRUE;
+    *max_depth = 0;
+    for (int k = 1; k < size && ok == TRUE; k++) {
+        VmInstruction *instruction = &function->file->code[function->start + k];
+        int needed = 0;
+        int change = 0;
+
+        if (instruction->cmd == LABEL_CM) {
+            // after goto or return only the jumps seen so far know the depth
+            if (depth < 0) {
+                depth = label_depth[k] >= 0 ? label_depth[k] : 0;
+            }
+            if (label_depth[k] >= 0 && label_depth[k] != depth) {
+                ok = FALSE;
+                break;
+            }
+            label_depth[k] = depth;
+        }
+        if (depth < 0) {
+            // unreachable, kept with an empty stack
+            depth = 0;
+        }
+        depths[k] = depth;
+
+        switch (instruction->cmd) {
+            case PUSH_CM:
+                change = 1;
+                break;
+            case POP_CM:
+            case IF_GOTO_CM:
+            case ADD_CM:
+            case SUB_CM:
+            case EQ_CM:
+            case GT_CM:
+            case LT_CM:
+            case AND_CM:
+            case OR_CM:
+                needed = instruction->cmd == POP_CM || instruction->cmd == IF_GOTO_CM ? 1 : 2;
+                change = -1;
+                break;
+            case NEG_CM:
+            case NOT_CM:
+            case RETURN_CM:
+                needed = 1;
+                break;
+            case CALL_CM:
+                needed = instruction->idx;
+                change = 1 - instruction->idx;
+                break;
+            default:
+                break;
+        }
+        if (depth < needed) {
+            ok = FALSE;
+            break;
+        }
+        depth += change;
+        if (depth > *max_depth) {
+            *max_depth = depth;
+        }
+
+        if (instruction->cmd == GOTO_CM || instruction->cmd == IF_GOTO_CM) {
+            int target = find_c_label(function, instruction->name);
+            if (target < 0) {
+                printf("%s: undefined label %s\n", function->name, instruction->name);
+                free(label_depth);
+                return FALSE;
+            }
+            referenced[target] = TRUE;
+            if (label_depth[target] >= 0 && label_depth[target] != depth) {
+                ok = FALSE;
+                break;
+            }
+            label_depth[target] = depth;
+        }
+        if (instruction->cmd == GOTO_CM || instruction->cmd == RETURN_CM) {
+            depth = -1;
+        }
+    }
+
+    if (ok == FALSE) {
+        printf("%s: inconsistent stack depth\n", function->name);
+    }
+    free(label_depth);
+    return ok;
+}
+
+// C expression of a segment location, constants are written by the caller
+void write_c_location(CFunction *function, MemorySegment seg, int idx) {
+    switch (seg) {
+        case LOCAL_SEG:
+            fprintf(c_file, "l%d", idx);
+            break;
+        case ARGUMENT_SEG:
+            fprintf(c_file, "a%d", idx);
+            break;
+        case THIS_SEG:
+            fprintf(c_file, "ram[(this_ + %d) & %d]", idx, RAM_MASK);
+            break;
+        case THAT_SEG:
+            fprintf(c_file, "ram[(that_ + %d) & %d]", idx, RAM_MASK);
+            break;
+        case POINTER_SEG:
+            fprintf(c_file, idx == 0 ? "this_" : "that_");
+            break;
+        case TEMP_SEG:
+            fprintf(c_file, "ram[%d]", 5 + idx);
+            break;
+        case STATIC_SEG:
+            fprintf(c_file, "ram[%d]", function->static_base + idx);
+            break;
+        default:
+            break;
+    }
+}
+
+void write_c_call(VmInstruction *instruction, int depth) {
+    int first = depth - instruction->idx;
+    int native = call_native(instruction);
+
+    if (native >= 0) {
+        fprintf(c_file, "    {\n        int16_t args[%d] = {", instruction->idx > 0 ? instruction->idx : 1);
+        for (int i = 0; i < instruction->idx; i++) {
+            fprintf(c_file, i == 0 ? "s%d" : ", s%d", first + i);
+        }
+        if (instruction->idx == 0) {
+            fprintf(c_file, "0");
+        }
+        fprintf(c_file, "};\n        s%d = os[%d](&machine, args);  // %s\n", first, native_slot(native), instruction->name);
+        fprintf(c_file, "        if (machine.halted) {\n            exit(machine.faulted);\n        }\n    }\n");
+        return;
+    }
+
+    CFunction *callee = &c_functions[find_c_function(instruction->name)];
+    fprintf(c_file, "    s%d = ", first);
+    write_c_identifier(callee->name);
+    fprintf(c_file, "(");
+    for (int i = 0; i < callee->args; i++) {
+        if (i < instruction->idx) {
+            fprintf(c_file, "s%d, ", first + i);
+        } else {
+            fprintf(c_file, "0, ");
+        }
+    }
+    fprintf(c_file, "this_, that_);\n");
+}
+
+void write_c_prototype(CFunction *function) {
+    fprintf(c_file, "int16_t ");
+    write_c_identifier(function->name);
+    fprintf(c_file, "(");
+    for (int i = 0; i < function->args; i++) {
+        fprintf(c_file, "int16_t a%d, ", i);
+    }
+    fprintf(c_file, "int16_t this_, int16_t that_)");
+}
+
+char *c_binary_operators[] = {"+", "-", "", "==", ">", "<", "&", "|"};
+
+int write_c_function(CFunction *function) {
+    int size = function->end - function->start;
+    int *depths = (int *)malloc(sizeof(int) * size);
+    int *referenced = (int *)malloc(sizeof(int) * size);
+    int max_depth = 0;
+
+    if (analyse_stack(function, depths, referenced, &max_depth) == FALSE) {
+        free(depths);
+        free(referenced);
+        return FALSE;
+    }
+
+    fprintf(c_file, "\n// %s\n", function->name);
+    write_c_prototype(function);
+    fprintf(c_file, " {\n");
+    for (int i = 0; i < function->file->code[function->start].idx; i++) {
+        fprintf(c_file, "    int16_t l%d = 0;\n", i);
+    }
+    for (int i = 0; i < max_depth; i++) {
+        fprintf(c_file, "    int16_t s%d;\n", i);
+    }
+
+    for (int k = 1; k < size; k++) {
+        VmInstruction *instruction = &function->file->code[function->start + k];
+        int depth = depths[k];
+
+        switch (instruction->cmd) {
+            case PUSH_CM:
+                fprintf(c_file, "    s%d = ", depth);
+                if (instruction->seg == CONST_SEG) {
+                    fprintf(c_file, "%d", instruction->idx);
+                } else {
+                    write_c_location(function, instruction->seg, instruction->idx);
+                }
+                fprintf(c_file, ";\n");
+                break;
+            case POP_CM:
+                fprintf(c_file, "    ");
+                write_c_location(function, instruction->seg, instruction->idx);
+                fprintf(c_file, " = s%d;\n", depth - 1);
+                break;
+            case ADD_CM:
+            case SUB_CM:
+            case AND_CM:
+            case OR_CM:
+                fprintf(c_file, "    s%d = s%d %s s%d;\n", depth - 2, depth - 2, c_binary_operators[instruction->cmd - ADD_CM], depth - 1);
+                break;
+            case EQ_CM:
+            case GT_CM:
+            case LT_CM:
+                fprintf(c_file, "    s%d = s%d %s s%d ? -1 : 0;\n", depth - 2, depth - 2, c_binary_operators[instruction->cmd - ADD_CM], depth - 1);
+                break;
+            case NEG_CM:
+                fprintf(c_file, "    s%d = -s%d;\n", depth - 1, depth - 1);
+                break;
+            case NOT_CM:
+                fprintf(c_file, "    s%d = ~s%d;\n", depth - 1, depth - 1);
+                break;
+            case LABEL_CM:
+                if (referenced[k] == TRUE) {
+                    fprintf(c_file, "L%d:;\n", k);
+                }
+                break;
+            case GOTO_CM:
+                fprintf(c_file, "    goto L%d;\n", find_c_label(function, instruction->name));
+                break;
+            case IF_GOTO_CM:
+                fprintf(c_file, "    if (s%d != 0) {\n        goto L%d;\n    }\n", depth - 1, find_c_label(function, instruction->name));
+                break;
+            case CALL_CM:
+                write_c_call(instruction, depth);
+                break;
+            case RETURN_CM:
+                fprintf(c_file, "    return s%d;\n", depth - 1);
+                break;
+            default:
+                break;
+        }
+    }
+    fprintf(c_file, "    return 0;\n}\n");
+
+    free(depths);
+    free(referenced);
+    return TRUE;
+}
+
+int translate_to_c(VmProgram *program, char *output_path) {
+    c_function_count = 0;
+    c_native_count = 0;
+    free(c_natives);
+    c_natives = NULL;
+
+    int ok = collect_c_functions(program);
+
+    // the OS entry point when the program has one, like the Hack bootstrap
+    int entry = find_c_function("Sys.init");
+    if (entry < 0) {
+        entry = find_c_function("Main.main");
+    }
+    if (ok == TRUE && entry < 0) {
+        printf("neither Sys.init nor Main.main is defined\n");
+        ok = FALSE;
+    }
+    if (ok == FALSE) {
+        free(c_functions);
+        c_functions = NULL;
+        return FALSE;
+    }
+
+    c_file = fopen(output_path, "w");
+    if (c_file == NULL) {
+        printf("error when trying to create or open the C file path\n");
+        free(c_functions);
+        c_functions = NULL;
+        return FALSE;
+    }
+
+    // the function bodies decide which natives are used, the table goes in front of them
+    char *body = NULL;
+    size_t body_size = 0;
+    FILE *output = c_file;
+    c_file = open_memstream(&body, &body_size);
+    for (int i = 0; i < c_function_count && ok == TRUE; i++) {
+        ok = write_c_function(&c_functions[i]);
+    }
+    fclose(c_file);
+    c_file = output;
+
+    fprintf(c_file, "// generated from VM code, build with natives.c from the compiler sources\n");
+    fprintf(c_file, "#include <stdint.h>\n#include <stdio.h>\n#include <stdlib.h>\n\n#include \"natives.h\"\n\n");
+    fprintf(c_file, "static Interpreter machine;\n#define ram machine.ram\n\n");
+    if (c_native_count > 0) {
+        fprintf(c_file, "static NativeFunction os[%d];\n\n", c_native_count);
+    }
+    for (int i = 0; i < c_function_count; i++) {
+        write_c_prototype(&c_functions[i]);
+        fprintf(c_file, ";\n");
+    }
+    if (body != NULL) {
+        fputs(body, c_file);
+        free(body);
+    }
+
+    fprintf(c_file, "\nint main() {\n");
+    fprintf(c_file, "    ram[0] = %d;\n    ram[1] = %d;\n    ram[2] = %d;\n", STACK_BASE, STACK_BASE, STACK_BASE);
+    fprintf(c_file, "    reset_natives(&machine);\n");
+    for (int i = 0; i < c_native_count; i++) {
+        fprintf(c_file, "    os[%d] = get_native(find_native(\"%s\"))->function;\n", i, get_native(c_natives[i])->name);
+    }
+    fprintf(c_file, "    int16_t result = ");
+    write_c_identifier(c_functions[entry].name);
+    fprintf(c_file, "(");
+    for (int i = 0; i < c_functions[entry].args; i++) {
+        fprintf(c_file, "0, ");
+    }
+    // built with -DPRINT_RESULT the program reports what the entry point returned, like the test interpreter
+    fprintf(c_file, "0, 0);\n#ifdef PRINT_RESULT\n    printf(\"\\nreturned %%d\\n\", result);\n#else\n");
+    fprintf(c_file, "    (void)result;\n#endif\n    return 0;\n}\n");
+    fclose(c_file);
+    c_file = NULL;
+
+    printf("%s: %d functions, %d native OS calls\n", output_path, c_function_count, c_native_count);
+    free(c_functions);
+    c_functions = NULL;
+    return ok;
+}
@@ -0,0 +1,10 @@
+#ifndef TRANSPILER_H
+#define TRANSPILER_H
+
+#include "vmcode.h"
+
+// writes the whole program as one C file, one C function per VM function
+// build it with: cc -O2 -I<compiler sources> out.c <compiler sources>/natives.c
+int translate_to_c(VmProgram *program, char *output_path);
+
+#endif
@@ -0,0 +1,248 @@
+#include "vmcode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirent.h"
+
+#define TRUE 1
+#define FALSE 0
+#define LINE_LEN 512
+
+// command and segment spellings shared with the code generator
+extern char *vm_commands[];
+extern char *memory_segments[];
+
+void init_vm_program(VmProgram *program) {
+    program->size = 0;
+    program->capacity = 16;
+    program->files = (VmFile *)malloc(sizeof(VmFile) * program->capacity);
+}
+
+void free_vm_program(VmProgram *program) {
+    for (int i = 0; i < program->size; i++) {
+        free(program->files[i].code);
+    }
+    free(program->files);
+    program->files = NULL;
+    program->size = 0;
+    program->capacity = 0;
+}
+
+VmFile *add_vm_file(VmProgram *program, char *path) {
+    if (program->size == program->capacity) {
+        program->capacity *= 2;
+        program->files = (VmFile *)realloc(program->files, sizeof(VmFile) * program->capacity);
+    }
+
+    VmFile *file = &program->files[program->size];
+    program->size += 1;
+
+    strncpy(file->path, path, VM_PATH_LEN - 1);
+    file->path[VM_PATH_LEN - 1] = '\0';
+
+    // class name is the file name without directory and suffix
+    const char *base = strrchr(path, '/');
+    base = base == NULL ? path : base + 1;
+    strncpy(file->class_name, base, VM_NAME_LEN - 1);
+    file->class_name[VM_NAME_LEN - 1] = '\0';
+    char *dot = strrchr(file->class_name, '.');
+    if (dot != NULL) {
+        *dot = '\0';
+    }
+
+    file->size = 0;
+    file->capacity = 256;
+    file->code = (VmInstruction *)malloc(sizeof(VmInstruction) * file->capacity);
+    return file;
+}
+
+void append_instruction(VmFile *file, VmInstruction instruction) {
+    if (file->size == file->capacity) {
+        file->capacity *= 2;
+        file->code = (VmInstruction *)realloc(file->code, sizeof(VmInstruction) * file->capacity);
+    }
+    file->code[file->size] = instruction;
+    file->size += 1;
+}
+
+int find_vm_command(char *word) {
+    for (int i = 0; i <= RETURN_CM; i++) {
+        if (strcmp(word, vm_commands[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int find_memory_segment(char *word) {
+    for (int i = 0; i <= CONST_SEG; i++) {
+        if (strcmp(word, memory_segments[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// parse one line of VM text, return FALSE for blank lines and comments and -1 for a malformed line
+int parse_vm_line(char *line, VmInstruction *instruction, int line_number, char *path) {
+    char *comment = strstr(line, "//");
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+
+    char *words[3] = {NULL, NULL, NULL};
+    int word_count = 0;
+    char *word = strtok(line, " \t\r\n");
+    while (word != NULL && word_count < 3) {
+        words[word_count] = word;
+        word_count += 1;
+        word = strtok(NULL, " \t\r\n");
+    }
+    if (word_count == 0) {
+        return FALSE;
+    }
+
+    int cmd = find_vm_command(words[0]);
+    if (cmd < 0) {
+        printf("%s:%d: unknown vm command %s\n", path, line_number, words[0]);
+        return -1;
+    }
+
+    instruction->cmd = cmd;
+    instruction->seg = CONST_SEG;
+    instruction->idx = 0;
+    instruction->name[0] = '\0';
+
+    if (cmd == PUSH_CM || cmd == POP_CM) {
+        int seg = word_count == 3 ? find_memory_segment(words[1]) : -1;
+        if (seg < 0) {
+            printf("%s:%d: bad memory segment\n", path, line_number);
+            return -1;
+        }
+        instruction->seg = seg;
+        instruction->idx = atoi(words[2]);
+    } else if (cmd == LABEL_CM || cmd == GOTO_CM || cmd == IF_GOTO_CM) {
+        if (word_count < 2) {
+            printf("%s:%d: label expected\n", path, line_number);
+            return -1;
+        }
+        strncpy(instruction->name, words[1], VM_NAME_LEN - 1);
+        instruction->name[VM_NAME_LEN - 1] = '\0';
+    } else if (cmd == FUNCTION_CM || cmd == CALL_CM) {
+        if (word_count < 3) {
+            printf("%s:%d: subroutine name and count expected\n", path, line_number);
+            return -1;
+        }
+        strncpy(instruction->name, words[1], VM_NAME_LEN - 1);
+        instruction->name[VM_NAME_LEN - 1] = '\0';
+        instruction->idx = atoi(words[2]);
+    }
+    return TRUE;
+}
+
+int read_vm_file(VmFile *file) {
+    FILE *input = fopen(file->path, "r");
+    if (input == NULL) {
+        printf("Error when reading the file %s\n", file->path);
+        return FALSE;
+    }
+
+    char line[LINE_LEN];
+    int line_number = 0;
+    while (fgets(line, LINE_LEN, input) != NULL) {
+        line_number += 1;
+        VmInstruction instruction;
+        int parsed = parse_vm_line(line, &instruction, line_number, file->path);
+        if (parsed < 0) {
+            fclose(input);
+            return FALSE;
+        }
+        if (parsed == TRUE) {
+            append_instruction(file, instruction);
+        }
+    }
+
+    fclose(input);
+    return TRUE;
+}
+
+// load every .vm file of a directory into the program
+int load_vm_program(VmProgram *program, char *dir_name) {
+    DIR *dir = opendir(dir_name);
+    if (dir == NULL) {
+        printf("Directory %s does not exist.\n", dir_name);
+        return FALSE;
+    }
+
+    struct dirent *vm_file;
+    char path[VM_PATH_LEN];
+    while ((vm_file = readdir(dir)) != NULL) {
+        const char *dot = strrchr(vm_file->d_name, '.');
+        if (dot == NULL || strcmp(dot, ".vm") != 0) {
+            continue;
+        }
+
+        snprintf(path, VM_PATH_LEN, "%s/%s", dir_name, vm_file->d_name);
+        VmFile *file = add_vm_file(program, path);
+        if (read_vm_file(file) == FALSE) {
+            closedir(dir);
+            return FALSE;
+        }
+    }
+
+    closedir(dir);
+    return TRUE;
+}
+
+void print_instruction(FILE *stream, VmInstruction *instruction) {
+    switch (instruction->cmd) {
+        case PUSH_CM:
+        case POP_CM:
+            fprintf(stream, "%s %s %d\n", vm_commands[instruction->cmd], memory_segments[instruction->seg], instruction->idx);
+            break;
+        case LABEL_CM:
+        case GOTO_CM:
+        case IF_GOTO_CM:
+            fprintf(stream, "%s %s\n", vm_commands[instruction->cmd], instruction->name);
+            break;
+        case FUNCTION_CM:
+        case CALL_CM:
+            fprintf(stream, "%s %s %d\n", vm_commands[instruction->cmd], instruction->name, instruction->idx);
+            break;
+        default:
+            fprintf(stream, "%s\n", vm_commands[instruction->cmd]);
+            break;
+    }
+}
+
+int write_vm_file(VmFile *file) {
+    FILE *output = fopen(file->path, "w");
+    if (output == NULL) {
+        printf("error when trying to create or open the compiled file path\n");
+        return FALSE;
+    }
+    for (int i = 0; i < file->size; i++) {
+        print_instruction(output, &file->code[i]);
+    }
+    fclose(output);
+    return TRUE;
+}
+
+int write_vm_program(VmProgram *program) {
+    for (int i = 0; i < program->size; i++) {
+        if (write_vm_file(&program->files[i]) == FALSE) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+int count_vm_instructions(VmProgram *program) {
+    int total = 0;
+    for (int i = 0; i < program->size; i++) {
+        total += program->files[i].size;
+    }
+    return total;
+}
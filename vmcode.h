@@ -0,0 +1,45 @@
+#ifndef VMCODE_H
+#define VMCODE_H
+
+#include <stdio.h>
+
+#include "compiler.h"
+
+#define VM_NAME_LEN 128
+#define VM_PATH_LEN 512
+
+// a single VM command held in memory, e.g. "push local 2" or "call Math.multiply 2"
+typedef struct {
+    VmCommand cmd;
+    MemorySegment seg;       // only meaningful for push / pop
+    int idx;                 // segment index, number of locals (function) or number of args (call)
+    char name[VM_NAME_LEN];  // label name, or Class.subroutine for function / call
+} VmInstruction;
+
+// the instruction stream of one .vm file, i.e. one Jack class
+typedef struct {
+    char path[VM_PATH_LEN];
+    char class_name[VM_NAME_LEN];  // file stem, used to qualify static variables
+    VmInstruction *code;
+    int size;
+    int capacity;
+} VmFile;
+
+typedef struct {
+    VmFile *files;
+    int size;
+    int capacity;
+} VmProgram;
+
+void init_vm_program(VmProgram *program);
+void free_vm_program(VmProgram *program);
+VmFile *add_vm_file(VmProgram *program, char *path);
+void append_instruction(VmFile *file, VmInstruction instruction);
+int read_vm_file(VmFile *file);
+int load_vm_program(VmProgram *program, char *dir_name);
+int write_vm_file(VmFile *file);
+int write_vm_program(VmProgram *program);
+void print_instruction(FILE *stream, VmInstruction *instruction);
+int count_vm_instructions(VmProgram *program);
+
+#endif
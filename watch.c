@@ -0,0 +1,107 @@
+#include "watch.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compiler.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+int is_jack_file_name(char *name) {
+    int length = strlen(name);
+    return length > 5 && strcmp(name + length - 5, ".jack") == 0;
+}
+
+// count the pending events on .jack files, -1 once the program directory is gone
+int read_watch_events(int fd, int program_watch) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    long size = read(fd, buffer, sizeof(buffer));
+    int changed = 0;
+    for (long offset = 0; offset < size;) {
+        struct inotify_event *event = (struct inotify_event *)(buffer + offset);
+        if (event->wd == program_watch && (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0) {
+            return -1;
+        }
+        // compiled .vm files land in the same directory, only sources count
+        if (event->len > 0 && is_jack_file_name(event->name) == TRUE) {
+            changed += 1;
+        }
+        offset += sizeof(struct inotify_event) + event->len;
+    }
+    return changed;
+}
+
+double elapsed_ms(struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+ParserInfo watch_build(char *dir_name, int changed) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ParserInfo parser_info = compile(dir_name);
+    if (parser_info.er != none) {
+        print_compile_error(parser_info);
+    }
+    if (changed < 0) {
+        printf("watch: built %s in %.3f ms\n", dir_name, elapsed_ms(&start));
+    } else {
+        printf("watch: %d change%s, rebuilt %s in %.3f ms\n", changed, changed == 1 ? "" : "s", dir_name, elapsed_ms(&start));
+    }
+    printf("watch: waiting for changes in %s\n", dir_name);
+    fflush(stdout);
+    return parser_info;
+}
+
+// build, then rebuild after every burst of saves until the program directory goes away;
+// the library and every file's tokens stay in memory and only affected classes are generated again
+ParserInfo watch_program(char *dir_name) {
+    CompilerOptions *options = get_compiler_options();
+    options->incremental = TRUE;
+    int fd = inotify_init1(IN_CLOEXEC);
+    int program_watch = fd >= 0 ? inotify_add_watch(fd, dir_name, WATCH_EVENTS) : -1;
+    if (program_watch < 0) {
+        printf("can not watch %s\n", dir_name);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return compile(dir_name);
+    }
+    // library sources are in the working directory
+    inotify_add_watch(fd, ".", WATCH_EVENTS);
+
+    SetTokenCaching(TRUE);
+    ParserInfo parser_info = watch_build(dir_name, -1);
+    while (TRUE) {
+        struct pollfd waiting = {fd, POLLIN, 0};
+        if (poll(&waiting, 1, -1) < 0) {
+            continue;
+        }
+        int changed = read_watch_events(fd, program_watch);
+
+        // debounce, an editor's save is several events and a checkout many files
+        while (changed >= 0 && poll(&waiting, 1, WATCH_DEBOUNCE_MS) > 0) {
+            int more = read_watch_events(fd, program_watch);
+            changed = more < 0 ? -1 : changed + more;
+        }
+        if (changed < 0) {
+            printf("watch: %s is gone\n", dir_name);
+            break;
+        }
+        if (changed > 0) {
+            parser_info = watch_build(dir_name, changed);
+        }
+    }
+
+    SetTokenCaching(FALSE);
+    close(fd);
+    return parser_info;
+}
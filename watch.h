@@ -0,0 +1,12 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "parser.h"
+
+// rebuild a program directory whenever its classes or the library change, for --watch
+
+#define WATCH_DEBOUNCE_MS 100  // quiet time after the last change before rebuilding, editors save in bursts
+
+ParserInfo watch_program(char *dir_name);
+
+#endif